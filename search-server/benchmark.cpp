@@ -0,0 +1,666 @@
+#include "benchmark.h"
+#include "search_server.h"
+#include "memory_resources.h"
+#include "term_dictionary.h"
+#include "string_processing.h"
+#include "score_kernels.h"
+#include "paginator.h"
+#include "query_budget.h"
+
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <random>
+
+using namespace std::literals;
+
+namespace {
+
+const int BENCHMARK_DOCUMENT_COUNT = 20000;
+const int BENCHMARK_QUERY_COUNT = 500;
+const int BENCHMARK_VOCABULARY_SIZE = 20000;
+const int BENCHMARK_DICTIONARY_SIZE = 1000000;
+const int BENCHMARK_FUZZY_QUERY_COUNT = 200;
+// Multi-term queries over the most frequent words, whose posting lists are dense
+const int BENCHMARK_FREQUENT_WORD_COUNT = 50;
+const int BENCHMARK_KERNEL_DOCUMENT_COUNT = 1 << 20;
+// Topics of the clustered corpus and the words of each
+const int BENCHMARK_TOPIC_COUNT = 64;
+const int BENCHMARK_TOPIC_VOCABULARY_SIZE = 300;
+
+std::string MakeWord(int index) {
+    std::string word = "w";
+    do {
+        word += static_cast<char>('a' + index % 26);
+        index /= 26;
+    } while (index > 0);
+    return word;
+}
+
+// Draws word indices so that the k-th word is drawn with probability proportional to 1 / k
+class ZipfWords {
+public:
+    ZipfWords(int vocabulary_size, unsigned seed)
+    : generator_(seed)
+    {
+        double sum = 0.0;
+        cumulative_.reserve(vocabulary_size);
+        for (int k = 1; k <= vocabulary_size; ++k) {
+            sum += 1.0 / k;
+            cumulative_.push_back(sum);
+        }
+    }
+
+    std::string Next() {
+        std::uniform_real_distribution<double> distribution(0.0, cumulative_.back());
+        const auto it = std::lower_bound(cumulative_.begin(), cumulative_.end(), distribution(generator_));
+        return MakeWord(static_cast<int>(it - cumulative_.begin()));
+    }
+
+    int NextInt(int min, int max) {
+        return std::uniform_int_distribution<int>(min, max)(generator_);
+    }
+
+private:
+    std::mt19937 generator_;
+    std::vector<double> cumulative_;
+};
+
+std::vector<std::string> GenerateTexts(int count, int min_words, int max_words, int vocabulary_size, unsigned seed, bool with_minus_words) {
+    ZipfWords words(vocabulary_size, seed);
+    std::vector<std::string> texts;
+    texts.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        std::string text;
+        const int word_count = words.NextInt(min_words, max_words);
+        for (int j = 0; j < word_count; ++j) {
+            if (!text.empty()) {
+                text += ' ';
+            }
+            if (with_minus_words && words.NextInt(0, 9) == 0) {
+                text += '-';
+            }
+            text += words.Next();
+        }
+        texts.push_back(std::move(text));
+    }
+    return texts;
+}
+
+double GetSecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Makes the given resource the default one for the lifetime of the object
+class DefaultResourceGuard {
+public:
+    explicit DefaultResourceGuard(std::pmr::memory_resource* resource)
+    : previous_(std::pmr::set_default_resource(resource))
+    {
+    }
+
+    ~DefaultResourceGuard() {
+        std::pmr::set_default_resource(previous_);
+    }
+
+private:
+    std::pmr::memory_resource* previous_;
+};
+
+void RunMemoryResourceCase(std::ostream& out, const std::string& name, bool use_pool,
+                           const std::vector<std::string>& documents, const std::vector<std::string>& queries) {
+    CountingResource index_upstream(std::pmr::new_delete_resource());
+    std::pmr::synchronized_pool_resource pool(&index_upstream);
+    SearchServer search_server("a the"s, use_pool ? static_cast<std::pmr::memory_resource*>(&pool) : &index_upstream);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    const double ingest_seconds = GetSecondsSince(start);
+
+    // Query temporaries only reach the default resource once the stack part of the arena is exhausted
+    CountingResource query_upstream(std::pmr::new_delete_resource());
+    size_t result_count = 0;
+    double query_seconds;
+    {
+        DefaultResourceGuard guard(&query_upstream);
+        start = std::chrono::steady_clock::now();
+        for (const std::string& query : queries) {
+            result_count += search_server.FindTopDocuments(query).size();
+        }
+        query_seconds = GetSecondsSince(start);
+    }
+
+    out << name << ": "
+        << "ingest " << documents.size() / ingest_seconds << " docs/s, "
+        << "index allocations " << index_upstream.GetAllocationCount() << ", "
+        << "index bytes " << index_upstream.GetBytesInUse() << "; "
+        << "queries " << queries.size() / query_seconds << " q/s, "
+        << "heap allocations per query " << static_cast<double>(query_upstream.GetAllocationCount()) / queries.size() << ", "
+        << "results " << result_count << std::endl;
+}
+
+// Same words spelled in Cyrillic, capitalized at the start of a sentence and followed by punctuation at its end
+std::vector<std::string> ToCyrillicSentences(const std::vector<std::string>& texts) {
+    std::vector<std::string> result;
+    result.reserve(texts.size());
+    for (const std::string& text : texts) {
+        std::string sentence;
+        bool is_sentence_start = true;
+        for (const char c : text) {
+            if (c == ' ') {
+                sentence += sentence.size() % 7 == 0 ? ". " : " ";
+                is_sentence_start = sentence.size() % 7 == 2;
+                continue;
+            }
+            // Letters а..щ take two bytes each, the capital ones are 0x20 code points before them
+            const int code_point = 0x430 + (c - 'a') - (is_sentence_start ? 0x20 : 0);
+            sentence += static_cast<char>(0xC0 | (code_point >> 6));
+            sentence += static_cast<char>(0x80 | (code_point & 0x3F));
+            is_sentence_start = false;
+        }
+        result.push_back(std::move(sentence));
+    }
+    return result;
+}
+
+void RunTokenizerCase(std::ostream& out, const std::string& name, const std::vector<std::string>& texts) {
+    size_t byte_count = 0;
+    for (const std::string& text : texts) {
+        byte_count += text.size();
+    }
+
+    size_t word_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& text : texts) {
+        word_count += SplitIntoWordsView(text).size();
+    }
+    const double split_seconds = GetSecondsSince(start);
+
+    size_t normalized_word_count = 0;
+    std::string buffer;
+    start = std::chrono::steady_clock::now();
+    for (const std::string& text : texts) {
+        buffer.assign(text);
+        NormalizeText(buffer.data(), buffer.size());
+        normalized_word_count += SplitIntoWordsView(buffer).size();
+    }
+    const double normalize_seconds = GetSecondsSince(start);
+
+    out << name << ": "
+        << "split by spaces " << byte_count / split_seconds / 1e6 << " MB/s, " << word_count << " words; "
+        << "normalized " << byte_count / normalize_seconds / 1e6 << " MB/s, " << normalized_word_count << " words" << std::endl;
+}
+
+void RunImpactCase(std::ostream& out, const std::string& name, ImpactPrecision precision,
+                   const std::vector<std::string>& documents, const std::vector<std::string>& queries,
+                   std::vector<std::vector<int>>& top_ids) {
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.SetImpactPrecision(precision);
+    search_server.Compact();
+
+    // The first case is the exact one, the others are compared to it
+    const bool is_reference = top_ids.empty();
+    size_t same_count = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        std::vector<int> ids;
+        for (const Document& document : search_server.FindTopDocuments(queries[i])) {
+            ids.push_back(document.id);
+        }
+        if (is_reference) {
+            top_ids.push_back(std::move(ids));
+        } else {
+            same_count += ids == top_ids[i];
+        }
+    }
+    const double seconds = GetSecondsSince(start);
+
+    out << name << ": "
+        << "queries " << queries.size() / seconds << " q/s";
+    if (!is_reference) {
+        out << ", same top as exact " << 100.0 * same_count / queries.size() << "%";
+    }
+    out << std::endl;
+}
+
+const char* GetScoreKernelName(ScoreKernel kernel) {
+    switch (kernel) {
+        case ScoreKernel::AVX2:
+            return "avx2";
+        case ScoreKernel::AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+} // namespace
+
+std::vector<std::string> GenerateBenchmarkDocuments(int document_count, int vocabulary_size, unsigned seed) {
+    return GenerateTexts(document_count, 10, 40, vocabulary_size, seed, false);
+}
+
+std::vector<std::string> GenerateBenchmarkQueries(int query_count, int vocabulary_size, unsigned seed) {
+    return GenerateTexts(query_count, 1, 6, vocabulary_size, seed, true);
+}
+
+void BenchmarkMemoryResources(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    const std::vector<std::string> queries = GenerateBenchmarkQueries(BENCHMARK_QUERY_COUNT, BENCHMARK_VOCABULARY_SIZE, 2);
+
+    RunMemoryResourceCase(out, "default allocator"s, false, documents, queries);
+    RunMemoryResourceCase(out, "pool resource"s, true, documents, queries);
+}
+
+void BenchmarkFuzzyExpansion(std::ostream& out) {
+    TermDictionary dictionary(std::pmr::get_default_resource());
+    for (int i = 0; i < BENCHMARK_DICTIONARY_SIZE; ++i) {
+        dictionary.Insert(MakeWord(i));
+    }
+
+    // Dictionary words with one random substitution
+    std::mt19937 generator(3);
+    std::vector<std::string> queries;
+    queries.reserve(BENCHMARK_FUZZY_QUERY_COUNT);
+    for (int i = 0; i < BENCHMARK_FUZZY_QUERY_COUNT; ++i) {
+        std::string word = MakeWord(std::uniform_int_distribution<int>(0, BENCHMARK_DICTIONARY_SIZE - 1)(generator));
+        word[std::uniform_int_distribution<size_t>(1, word.size() - 1)(generator)] = static_cast<char>('a' + generator() % 26);
+        queries.push_back(std::move(word));
+    }
+
+    for (int max_distance = 1; max_distance <= 2; ++max_distance) {
+        size_t match_count = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (const std::string& query : queries) {
+            match_count += dictionary.FindWithinDistance(query, max_distance, std::pmr::get_default_resource()).size();
+        }
+        const double seconds = GetSecondsSince(start);
+        out << "fuzzy expansion over " << dictionary.GetTermCount() << " terms, distance " << max_distance << ": "
+            << seconds * 1e6 / queries.size() << " us per word, "
+            << static_cast<double>(match_count) / queries.size() << " matches per word" << std::endl;
+    }
+}
+
+void BenchmarkTokenizer(std::ostream& out) {
+    const std::vector<std::string> texts = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    RunTokenizerCase(out, "ascii tokenizer"s, texts);
+    RunTokenizerCase(out, "cyrillic tokenizer"s, ToCyrillicSentences(texts));
+}
+
+void BenchmarkImpactScores(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    const std::vector<std::string> queries = GenerateBenchmarkQueries(BENCHMARK_QUERY_COUNT, BENCHMARK_VOCABULARY_SIZE, 2);
+
+    std::vector<std::vector<int>> top_ids;
+    RunImpactCase(out, "exact scores"s, ImpactPrecision::NONE, documents, queries, top_ids);
+    RunImpactCase(out, "16-bit impacts"s, ImpactPrecision::BITS_16, documents, queries, top_ids);
+    RunImpactCase(out, "8-bit impacts"s, ImpactPrecision::BITS_8, documents, queries, top_ids);
+}
+
+void BenchmarkDocumentReordering(std::ostream& out) {
+    // Every document draws most of its words from its own topic and a few from the common ones,
+    // topics come in random order so that documents of a topic are spread over the whole id range
+    std::mt19937 generator(6);
+    ZipfWords words(BENCHMARK_TOPIC_VOCABULARY_SIZE, 7);
+    auto make_text = [&](int topic, int word_count) {
+        std::string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (!text.empty()) {
+                text += ' ';
+            }
+            // Words of a topic are w<index> with the topic in the low digits, the common ones are those of topic 0
+            const int common = generator() % 5 == 0;
+            const std::string word = words.Next();
+            text += word + MakeWord(common ? 0 : topic);
+        }
+        return text;
+    };
+    std::vector<std::string> documents;
+    for (int i = 0; i < BENCHMARK_DOCUMENT_COUNT; ++i) {
+        documents.push_back(make_text(generator() % BENCHMARK_TOPIC_COUNT + 1, words.NextInt(10, 40)));
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < BENCHMARK_QUERY_COUNT; ++i) {
+        queries.push_back(make_text(generator() % BENCHMARK_TOPIC_COUNT + 1, words.NextInt(2, 4)));
+    }
+
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    auto run_queries = [&](const std::string& name) {
+        const auto start = std::chrono::steady_clock::now();
+        size_t result_count = 0;
+        for (int repeat = 0; repeat < 4; ++repeat) {
+            for (const std::string& query : queries) {
+                result_count += search_server.FindTopDocuments(std::execution::seq, query).size();
+            }
+        }
+        out << name << ": "
+            << "posting gaps " << search_server.GetDeltaEncodedPostingBits() / 8 << " bytes as gamma codes, "
+            << "queries " << 4 * queries.size() / GetSecondsSince(start) << " q/s, "
+            << "results " << result_count << std::endl;
+    };
+    search_server.Compact();
+    run_queries("ids in order of addition"s);
+    const auto start = std::chrono::steady_clock::now();
+    search_server.ReorderDocuments();
+    out << "reordering " << GetSecondsSince(start) << " s" << std::endl;
+    run_queries("ids in order of MinHash signatures"s);
+}
+
+void BenchmarkPagination(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.Compact();
+
+    // The most frequent words match most of the corpus
+    const std::string query = MakeWord(0) + " "s + MakeWord(1) + " "s + MakeWord(2);
+    const size_t page_size = 20;
+    const int repeat_count = 20;
+    std::optional<Document> cursor;
+    for (int page = 1; page <= 200; ++page) {
+        if (page == 1 || page == 10 || page == 100 || page == 200) {
+            // The page by its cursor against the top of all documents up to it, cut to the last page
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat_count; ++i) {
+                search_server.FindTopDocumentsAfter(query, cursor, page_size);
+            }
+            const double cursor_seconds = GetSecondsSince(start) / repeat_count;
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat_count; ++i) {
+                const std::vector<Document> top = search_server.FindTopDocumentsAfter(query, std::nullopt, page * page_size);
+                const auto pages = PaginateLazily(top, page_size);
+                pages[page - 1];
+            }
+            const double offset_seconds = GetSecondsSince(start) / repeat_count;
+            out << "page " << page << " of " << page_size << " documents: "
+                << "by cursor " << cursor_seconds * 1e6 << " us, "
+                << "by offset " << offset_seconds * 1e6 << " us" << std::endl;
+        }
+        const std::vector<Document> documents_of_page = search_server.FindTopDocumentsAfter(query, cursor, page_size);
+        if (documents_of_page.empty()) {
+            break;
+        }
+        cursor = documents_of_page.back();
+    }
+}
+
+void BenchmarkQueryBudget(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.Compact();
+
+    // Ordinary queries with one in a hundred made of the most frequent words only
+    std::vector<std::string> queries = GenerateBenchmarkQueries(BENCHMARK_QUERY_COUNT, BENCHMARK_VOCABULARY_SIZE, 2);
+    const std::vector<std::string> heavy_queries = GenerateTexts(BENCHMARK_QUERY_COUNT / 100, 8, 10, 20, 8, false);
+    for (size_t i = 0; i < heavy_queries.size(); ++i) {
+        queries[i * 100] = heavy_queries[i];
+    }
+
+    auto run_queries = [&](const std::string& name, std::optional<std::chrono::microseconds> timeout) {
+        std::vector<double> latencies;
+        size_t partial_count = 0;
+        for (int repeat = 0; repeat < 4; ++repeat) {
+            for (const std::string& query : queries) {
+                const auto start = std::chrono::steady_clock::now();
+                if (timeout.has_value()) {
+                    QueryBudget budget;
+                    budget.SetTimeout(*timeout);
+                    search_server.FindTopDocuments(std::execution::seq, query, DocumentStatus::ACTUAL, budget);
+                    partial_count += budget.IsExhausted();
+                } else {
+                    search_server.FindTopDocuments(std::execution::seq, query);
+                }
+                latencies.push_back(GetSecondsSince(start) * 1e6);
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double share) {
+            return latencies[std::min(latencies.size() - 1, static_cast<size_t>(share * latencies.size()))];
+        };
+        out << name << ": "
+            << "p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p999 " << percentile(0.999) << " us, "
+            << "max " << latencies.back() << " us, partial " << partial_count << " of " << latencies.size() << std::endl;
+    };
+    run_queries("queries without a budget"s, std::nullopt);
+    run_queries("queries with a 300 us deadline"s, std::chrono::microseconds(300));
+}
+
+void BenchmarkChampionLists(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.Compact();
+
+    // Head queries: one or two of the most frequent words
+    const std::vector<std::string> queries = GenerateTexts(BENCHMARK_QUERY_COUNT, 1, 2, BENCHMARK_FREQUENT_WORD_COUNT, 9, false);
+    auto run_queries = [&](const std::string& name, bool use_champion_lists) {
+        ExecutionThresholds thresholds = GetExecutionThresholds();
+        thresholds.use_champion_lists = use_champion_lists;
+        search_server.SetExecutionThresholds(thresholds);
+        size_t result_count = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < 4; ++repeat) {
+            for (const std::string& query : queries) {
+                result_count += search_server.FindTopDocuments(std::execution::seq, query).size();
+            }
+        }
+        out << name << ": " << 4 * queries.size() / GetSecondsSince(start) << " q/s, results " << result_count << std::endl;
+    };
+    run_queries("head queries, posting lists"s, false);
+    run_queries("head queries, champion lists"s, true);
+    search_server.SetExecutionThresholds(GetExecutionThresholds());
+}
+
+void BenchmarkDocumentUpdates(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.Compact();
+
+    const int update_count = 20000;
+    std::mt19937 generator(10);
+    auto flip_status = [&](int id) {
+        return (id + generator()) % 2 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+    };
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < update_count; ++i) {
+        const int id = static_cast<int>(generator() % documents.size());
+        search_server.UpdateDocumentAttributes(id, flip_status(id), {id % 10});
+    }
+    out << "status flips in place: " << update_count / GetSecondsSince(start) << " updates/s" << std::endl;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < update_count; ++i) {
+        const int id = static_cast<int>(generator() % documents.size());
+        search_server.RemoveDocument(id);
+        search_server.AddDocument(id, documents[id], flip_status(id), {id % 10});
+    }
+    out << "status flips by remove and add: " << update_count / GetSecondsSince(start) << " updates/s" << std::endl;
+
+    // Edits that append one word, and saves that don't change the terms
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < update_count; ++i) {
+        const int id = static_cast<int>(generator() % documents.size());
+        search_server.UpdateDocument(id, documents[id] + " "s + MakeWord(i % 100));
+    }
+    out << "text edits: " << update_count / GetSecondsSince(start) << " updates/s" << std::endl;
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.UpdateDocument(id, documents[id]);
+    }
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < update_count; ++i) {
+        const int id = static_cast<int>(generator() % documents.size());
+        search_server.UpdateDocument(id, documents[id]);
+    }
+    out << "text saves without changes: " << update_count / GetSecondsSince(start) << " updates/s" << std::endl;
+}
+
+void BenchmarkDocumentFilter(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 100});
+    }
+    search_server.Compact();
+
+    const std::vector<std::string> queries = GenerateBenchmarkQueries(BENCHMARK_QUERY_COUNT, BENCHMARK_VOCABULARY_SIZE, 2);
+    auto run_queries = [&](const std::string& name, const DocumentFilter& filter) {
+        size_t result_count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& query : queries) {
+            result_count += search_server.FindTopDocuments(std::execution::seq, query, [&filter](int document_id, DocumentStatus status, int rating) {
+                return filter.IsMatch(status, rating);
+            }).size();
+        }
+        out << name << ", predicate: " << queries.size() / GetSecondsSince(start) << " q/s, results " << result_count << std::endl;
+        result_count = 0;
+        start = std::chrono::steady_clock::now();
+        for (const std::string& query : queries) {
+            result_count += search_server.FindTopDocuments(std::execution::seq, query, filter).size();
+        }
+        out << name << ", filter: " << queries.size() / GetSecondsSince(start) << " q/s, results " << result_count << std::endl;
+    };
+    DocumentFilter filter;
+    filter.min_rating = 42;
+    filter.max_rating = 42;
+    run_queries("rating 42 of 0..99"s, filter);
+    filter.max_rating = 46;
+    run_queries("rating 42..46 of 0..99"s, filter);
+    filter.max_rating = 99;
+    run_queries("rating 42..99 of 0..99"s, filter);
+}
+
+void BenchmarkFacetCounts(std::ostream& out) {
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT), {id % 100});
+    }
+    search_server.Compact();
+
+    const std::vector<std::string> queries = GenerateBenchmarkQueries(BENCHMARK_QUERY_COUNT, BENCHMARK_VOCABULARY_SIZE, 2);
+    std::vector<int> rating_bounds;
+    for (int bound = 0; bound < 100; bound += 10) {
+        rating_bounds.push_back(bound);
+    }
+
+    // Top documents, then a query per status and per rating bucket that counts its matches in the predicate.
+    // A champion list would call the predicate before falling back to the postings and count some matches twice.
+    ExecutionThresholds thresholds = GetExecutionThresholds();
+    thresholds.use_champion_lists = false;
+    search_server.SetExecutionThresholds(thresholds);
+    size_t match_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& query : queries) {
+        search_server.FindTopDocuments(std::execution::seq, query);
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            search_server.FindTopDocuments(std::execution::seq, query, [&](int document_id, DocumentStatus document_status, int rating) {
+                match_count += document_status == static_cast<DocumentStatus>(status) ? 1 : 0;
+                return false;
+            });
+        }
+        for (const int bound : rating_bounds) {
+            search_server.FindTopDocuments(std::execution::seq, query, [&](int document_id, DocumentStatus document_status, int rating) {
+                match_count += bound <= rating && rating < bound + 10 ? 1 : 0;
+                return false;
+            });
+        }
+    }
+    out << "facets by a query per value: " << queries.size() / GetSecondsSince(start) << " q/s, counted " << match_count << std::endl;
+
+    match_count = 0;
+    FacetCounts facets(rating_bounds);
+    start = std::chrono::steady_clock::now();
+    for (const std::string& query : queries) {
+        search_server.FindTopDocuments(std::execution::seq, query, DocumentStatus::ACTUAL, facets);
+        match_count += 2 * facets.GetMatchCount();
+    }
+    out << "facets in the same pass: " << queries.size() / GetSecondsSince(start) << " q/s, counted " << match_count << std::endl;
+    search_server.SetExecutionThresholds(GetExecutionThresholds());
+}
+
+void BenchmarkScoreKernels(std::ostream& out) {
+    const std::vector<ScoreKernel> kernels = {ScoreKernel::SCALAR, ScoreKernel::AVX2, ScoreKernel::AVX512};
+
+    // Kernels alone: a posting list over a quarter of a million documents, an eighth of them excluded
+    std::mt19937 generator(4);
+    std::vector<int> internal_ids;
+    std::vector<double> term_freqs;
+    std::vector<int> minus_ids;
+    for (int internal_id = 0; internal_id < BENCHMARK_KERNEL_DOCUMENT_COUNT; ++internal_id) {
+        if (generator() % 4 == 0) {
+            internal_ids.push_back(internal_id);
+            term_freqs.push_back(1.0 / (generator() % 20 + 1));
+        }
+        if (generator() % 8 == 0) {
+            minus_ids.push_back(internal_id);
+        }
+    }
+    std::vector<uint32_t> exclusion_mask(GetExclusionMaskSize(BENCHMARK_KERNEL_DOCUMENT_COUNT), 0);
+    AddToExclusionMask(minus_ids.data(), minus_ids.size(), 0, BENCHMARK_KERNEL_DOCUMENT_COUNT, exclusion_mask.data());
+    std::vector<double> scores(BENCHMARK_KERNEL_DOCUMENT_COUNT, 0.0);
+    for (const ScoreKernel kernel : kernels) {
+        if (!IsScoreKernelSupported(kernel)) {
+            continue;
+        }
+        const int repeat_count = 20;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat_count; ++i) {
+            AccumulateScores(kernel, internal_ids.data(), term_freqs.data(), internal_ids.size(), 0.5, 0,
+                             exclusion_mask.data(), scores.data());
+        }
+        const double seconds = GetSecondsSince(start);
+        out << GetScoreKernelName(kernel) << " kernel: "
+            << seconds * 1e9 / (repeat_count * internal_ids.size()) << " ns per posting" << std::endl;
+    }
+
+    // End to end: posting lists merged document at a time against dense scoring with every kernel
+    const std::vector<std::string> documents = GenerateBenchmarkDocuments(BENCHMARK_DOCUMENT_COUNT, BENCHMARK_VOCABULARY_SIZE, 1);
+    const std::vector<std::string> queries = GenerateTexts(BENCHMARK_QUERY_COUNT, 3, 6, BENCHMARK_FREQUENT_WORD_COUNT, 5, false);
+    SearchServer search_server("a the"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id % 10});
+    }
+    search_server.Compact();
+
+    const ScoreKernel default_kernel = GetScoreKernel();
+    auto run_queries = [&](const std::string& name, double min_dense_scoring_density) {
+        ExecutionThresholds thresholds = GetExecutionThresholds();
+        thresholds.min_dense_scoring_density = min_dense_scoring_density;
+        // The kernels are measured on the posting lists, not on the champion lists
+        thresholds.use_champion_lists = false;
+        search_server.SetExecutionThresholds(thresholds);
+        const auto start = std::chrono::steady_clock::now();
+        for (const std::string& query : queries) {
+            search_server.FindTopDocuments(std::execution::seq, query);
+        }
+        out << name << ": " << queries.size() / GetSecondsSince(start) << " q/s" << std::endl;
+    };
+    run_queries("multi-term queries, merged posting lists"s, std::numeric_limits<double>::infinity());
+    for (const ScoreKernel kernel : kernels) {
+        if (IsScoreKernelSupported(kernel)) {
+            SetScoreKernel(kernel);
+            run_queries("multi-term queries, dense scores with "s + GetScoreKernelName(kernel) + " kernel"s, 0.0);
+        }
+    }
+    SetScoreKernel(default_kernel);
+}
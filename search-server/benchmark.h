@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Zipf-distributed word frequencies, the same corpus for the same seed
+std::vector<std::string> GenerateBenchmarkDocuments(int document_count, int vocabulary_size, unsigned seed);
+std::vector<std::string> GenerateBenchmarkQueries(int query_count, int vocabulary_size, unsigned seed);
+
+// Default allocator against a pool
+void BenchmarkMemoryResources(std::ostream& out);
+// Splitting by spaces against normalizing first
+void BenchmarkTokenizer(std::ostream& out);
+// Exact scores against quantized impacts
+void BenchmarkImpactScores(std::ostream& out);
+void BenchmarkScoreKernels(std::ostream& out);
+// Search-after cursor against ranking every document up to the page
+void BenchmarkPagination(std::ostream& out);
+void BenchmarkQueryBudget(std::ostream& out);
+void BenchmarkChampionLists(std::ostream& out);
+void BenchmarkDocumentUpdates(std::ostream& out);
+// Predicate against structured filter
+void BenchmarkDocumentFilter(std::ostream& out);
+// A query per facet value against counting in the ranking pass
+void BenchmarkFacetCounts(std::ostream& out);
+void BenchmarkDocumentReordering(std::ostream& out);
+void BenchmarkFuzzyExpansion(std::ostream& out);
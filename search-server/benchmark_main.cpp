@@ -0,0 +1,19 @@
+#include "benchmark.h"
+
+#include <iostream>
+
+int main() {
+    BenchmarkMemoryResources(std::cout);
+    BenchmarkTokenizer(std::cout);
+    BenchmarkImpactScores(std::cout);
+    BenchmarkScoreKernels(std::cout);
+    BenchmarkDocumentReordering(std::cout);
+    BenchmarkPagination(std::cout);
+    BenchmarkQueryBudget(std::cout);
+    BenchmarkChampionLists(std::cout);
+    BenchmarkDocumentUpdates(std::cout);
+    BenchmarkDocumentFilter(std::cout);
+    BenchmarkFacetCounts(std::cout);
+    BenchmarkFuzzyExpansion(std::cout);
+    return 0;
+}
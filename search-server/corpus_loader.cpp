@@ -0,0 +1,207 @@
+#include "corpus_loader.h"
+#include "mapped_file.h"
+
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+struct CorpusRecord {
+    int id;
+    DocumentStatus status;
+    std::vector<int> ratings;
+    // Points into the mapping
+    std::string_view text;
+};
+
+struct CorpusBatch {
+    std::vector<CorpusRecord> records;
+    // Offset in the file right after the last line of the batch
+    size_t end_offset = 0;
+};
+
+// Single-producer single-consumer queue that blocks the producer when full
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity)
+    : capacity_(capacity)
+    {
+    }
+
+    // Returns false if the consumer has gone
+    bool Push(CorpusBatch batch) {
+        std::unique_lock lock(guard_);
+        not_full_.wait(lock, [this] { return batches_.size() < capacity_ || is_cancelled_; });
+        if (is_cancelled_) {
+            return false;
+        }
+        batches_.push_back(std::move(batch));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Returns false once the producer has finished and the queue is drained
+    bool Pop(CorpusBatch& batch) {
+        std::unique_lock lock(guard_);
+        not_empty_.wait(lock, [this] { return !batches_.empty() || is_finished_; });
+        if (batches_.empty()) {
+            return false;
+        }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void Finish(std::exception_ptr error) {
+        std::lock_guard guard(guard_);
+        is_finished_ = true;
+        error_ = error;
+        not_empty_.notify_one();
+    }
+
+    void Cancel() {
+        std::lock_guard guard(guard_);
+        is_cancelled_ = true;
+        not_full_.notify_one();
+    }
+
+    std::exception_ptr GetError() {
+        std::lock_guard guard(guard_);
+        return error_;
+    }
+
+private:
+    const size_t capacity_;
+    std::deque<CorpusBatch> batches_;
+    bool is_finished_ = false;
+    bool is_cancelled_ = false;
+    std::exception_ptr error_;
+    std::mutex guard_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid number");
+    }
+    return value;
+}
+
+// Cuts the next tab-separated field off the line
+std::string_view TakeField(std::string_view& line) {
+    const size_t tab = line.find('\t');
+    if (tab == line.npos) {
+        throw std::invalid_argument("Missing field");
+    }
+    const std::string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+CorpusRecord ParseRecord(std::string_view line) {
+    CorpusRecord record;
+    record.id = ParseInt(TakeField(line));
+    record.status = ParseDocumentStatus(TakeField(line));
+    for (const std::string_view rating : SplitIntoWordsView(TakeField(line))) {
+        record.ratings.push_back(ParseInt(rating));
+    }
+    record.text = line;
+    return record;
+}
+
+void ParseCorpus(std::string_view text, size_t batch_size, BatchQueue& queue) {
+    CorpusBatch batch;
+    size_t offset = 0;
+    size_t line_number = 0;
+    while (offset < text.size()) {
+        size_t line_end = text.find('\n', offset);
+        if (line_end == text.npos) {
+            line_end = text.size();
+        }
+        const size_t line_start = offset;
+        std::string_view line = text.substr(offset, line_end - offset);
+        offset = line_end + 1;
+        ++line_number;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            batch.records.push_back(ParseRecord(line));
+        } catch (const std::invalid_argument& error) {
+            // Lines before the malformed one are still added
+            if (!batch.records.empty()) {
+                batch.end_offset = line_start;
+                queue.Push(std::move(batch));
+            }
+            throw std::invalid_argument("Corpus line " + std::to_string(line_number) + ": " + error.what());
+        }
+
+        if (batch.records.size() >= batch_size) {
+            batch.end_offset = std::min(offset, text.size());
+            if (!queue.Push(std::move(batch))) {
+                return;
+            }
+            batch = CorpusBatch();
+        }
+    }
+    if (!batch.records.empty()) {
+        batch.end_offset = text.size();
+        queue.Push(std::move(batch));
+    }
+}
+
+} // namespace
+
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t batch_size) {
+    const MappedFile file(path);
+    BatchQueue queue(CORPUS_QUEUED_BATCH_COUNT);
+
+    std::thread parser([&file, &queue, batch_size] {
+        try {
+            ParseCorpus(file.GetText(), std::max<size_t>(batch_size, 1), queue);
+            queue.Finish(nullptr);
+        } catch (...) {
+            queue.Finish(std::current_exception());
+        }
+    });
+
+    size_t document_count = 0;
+    size_t released_offset = 0;
+    try {
+        CorpusBatch batch;
+        while (queue.Pop(batch)) {
+            search_server.RunWriteBatch([&search_server, &batch, &document_count] {
+                for (const CorpusRecord& record : batch.records) {
+                    search_server.AddDocument(record.id, record.text, record.status, record.ratings);
+                    ++document_count;
+                }
+            });
+            // Words are copied into the index, the indexed text is not needed anymore
+            file.Release(released_offset, batch.end_offset);
+            released_offset = batch.end_offset;
+        }
+    } catch (...) {
+        queue.Cancel();
+        parser.join();
+        throw;
+    }
+    parser.join();
+
+    if (const std::exception_ptr error = queue.GetError()) {
+        std::rethrow_exception(error);
+    }
+    return document_count;
+}
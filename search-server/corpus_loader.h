@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "search_server.h"
+
+const size_t CORPUS_BATCH_SIZE = 1024;
+// Parsed batches the parser thread runs ahead of indexing
+const size_t CORPUS_QUEUED_BATCH_COUNT = 2;
+
+// One document per line: <id> TAB <status> TAB <ratings separated by spaces> TAB <text>
+// Returns the number of added documents. Throws std::invalid_argument on a malformed line, documents
+// of the lines before it stay added. Throws std::runtime_error if the file can't be mapped.
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t batch_size = CORPUS_BATCH_SIZE);
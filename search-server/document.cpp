@@ -1,5 +1,7 @@
 #include "document.h"
 
+#include <stdexcept>
+
 Document::Document() = default;
 
 Document::Document(int id, double relevance, int rating)
@@ -9,6 +11,41 @@ Document::Document(int id, double relevance, int rating)
 {
 }
 
+DocumentStatus ParseDocumentStatus(std::string_view name) {
+    using namespace std::literals;
+    if (name == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    }
+    if (name == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (name == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    }
+    if (name == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    throw std::invalid_argument("Unknown document status");
+}
+
+std::string_view GetDocumentStatusName(const DocumentStatus& status) {
+    using namespace std::literals;
+    switch (status) {
+        case DocumentStatus::ACTUAL:
+            return "ACTUAL"sv;
+        case DocumentStatus::IRRELEVANT:
+            return "IRRELEVANT"sv;
+        case DocumentStatus::BANNED:
+            return "BANNED"sv;
+        default:
+            return "REMOVED"sv;
+    }
+}
+
+bool DocumentFilter::IsMatch(const DocumentStatus& document_status, int rating) const {
+    return (!status.has_value() || document_status == *status) && min_rating <= rating && rating <= max_rating;
+}
+
 std::ostream& operator<<(std::ostream& out, const Document& document) {
     out << "{ document_id = " << document.id << ", ";
     out << "relevance = " << document.relevance << ", ";
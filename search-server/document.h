@@ -1,6 +1,10 @@
 #pragma once
 
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document();
@@ -18,4 +22,20 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Throws std::invalid_argument on an unknown name
+DocumentStatus ParseDocumentStatus(std::string_view name);
+std::string_view GetDocumentStatusName(const DocumentStatus& status);
+
+// Unlike a predicate, applied through the indexes before scoring
+struct DocumentFilter {
+    bool IsMatch(const DocumentStatus& document_status, int rating) const;
+
+    // Any status if not set
+    std::optional<DocumentStatus> status = DocumentStatus::ACTUAL;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    // Unknown ids are ignored
+    std::optional<std::vector<int>> document_ids;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
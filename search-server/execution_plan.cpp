@@ -0,0 +1,82 @@
+#include "execution_plan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Starting tasks and waking threads is never free, whatever the measurement says
+const double MIN_DISPATCH_COST = 1000.0;
+
+// Repeats the measurement and keeps the fastest run to filter out preemption
+template <typename Function>
+double MeasureMinNanoseconds(int repeat_count, Function function) {
+    using Clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repeat_count; ++i) {
+        const auto start = Clock::now();
+        function();
+        const std::chrono::duration<double, std::nano> duration = Clock::now() - start;
+        best = std::min(best, duration.count());
+    }
+    return best;
+}
+
+} // namespace
+
+size_t ExecutionThresholds::GetMinParallelWork(size_t thread_count) const {
+    if (thread_count <= 1) {
+        return std::numeric_limits<size_t>::max();
+    }
+    // Parallel run pays off when work * posting_cost > dispatch_cost + work * posting_cost / thread_count,
+    // doubled to cover the merge of partial results
+    const double speedup_share = 1.0 - 1.0 / thread_count;
+    return static_cast<size_t>(2.0 * dispatch_cost / (posting_cost * speedup_share)) + 1;
+}
+
+ExecutionThresholds CalibrateExecutionThresholds(ThreadPool& thread_pool) {
+    const int posting_count = 1 << 14;
+    std::vector<int> internal_ids(posting_count);
+    std::vector<double> term_freqs(posting_count);
+    for (int i = 0; i < posting_count; ++i) {
+        internal_ids[i] = i * 3;
+        term_freqs[i] = 1.0 / (i + 1);
+    }
+
+    // The same work as the sequential scoring loop: walk a posting list of a segment, collect scored documents
+    auto score = [&internal_ids, &term_freqs](int first_id, int last_id) {
+        std::vector<std::pair<int, double>> matched_documents;
+        size_t position = std::lower_bound(internal_ids.begin(), internal_ids.end(), first_id) - internal_ids.begin();
+        for (; position < internal_ids.size() && internal_ids[position] < last_id; ++position) {
+            matched_documents.emplace_back(internal_ids[position], term_freqs[position] * 0.5);
+        }
+        return matched_documents.size();
+    };
+
+    ExecutionThresholds thresholds;
+    const double sequential_time = MeasureMinNanoseconds(3, [&score] {
+        score(0, std::numeric_limits<int>::max());
+    });
+    thresholds.posting_cost = sequential_time / posting_count;
+
+    // Whatever the parallel run loses to an ideal split of the same work is the dispatch cost
+    const size_t thread_count = thread_pool.GetThreadCount();
+    if (thread_count > 1) {
+        const int id_step = posting_count * 3 / static_cast<int>(thread_count) + 1;
+        const double parallel_time = MeasureMinNanoseconds(3, [&] {
+            thread_pool.ParallelFor(thread_count, [&](size_t index) {
+                score(static_cast<int>(index) * id_step, static_cast<int>(index + 1) * id_step);
+            });
+        });
+        thresholds.dispatch_cost = std::max(parallel_time - sequential_time / thread_count, MIN_DISPATCH_COST);
+    }
+    return thresholds;
+}
+
+const ExecutionThresholds& GetExecutionThresholds() {
+    static const ExecutionThresholds thresholds = CalibrateExecutionThresholds(GetDefaultThreadPool());
+    return thresholds;
+}
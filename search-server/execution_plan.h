@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+#include "thread_pool.h"
+
+// The server chooses between sequential and parallel execution from posting list sizes
+struct AdaptiveExecutionPolicy {
+};
+
+inline constexpr AdaptiveExecutionPolicy adaptive_execution;
+
+enum class ExecutionPath {
+    SEQUENTIAL,
+    PARALLEL_SEGMENTS,
+    // Chunks of equal work
+    PARALLEL_CHUNKS,
+};
+
+struct ExecutionThresholds {
+    // ns
+    double posting_cost = 50.0;
+    double dispatch_cost = 20000.0;
+    // Postings per document of a scoring range from which union queries are scored in a dense array
+    double min_dense_scoring_density = 0.5;
+    bool use_champion_lists = true;
+
+    size_t GetMinParallelWork(size_t thread_count) const;
+};
+
+ExecutionThresholds CalibrateExecutionThresholds(ThreadPool& thread_pool);
+
+// Calibrated on the default pool on first call
+const ExecutionThresholds& GetExecutionThresholds();
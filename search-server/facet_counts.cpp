@@ -0,0 +1,56 @@
+#include "facet_counts.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+FacetCounts::FacetCounts(std::vector<int> rating_bounds)
+: rating_bounds_(std::move(rating_bounds))
+, rating_counts_(rating_bounds_.size(), 0)
+{
+}
+
+void FacetCounts::Add(const DocumentStatus& status, int rating, bool is_hit) {
+    hit_count_ += is_hit ? 1 : 0;
+    ++status_counts_[static_cast<size_t>(status)];
+    const auto bound = std::upper_bound(rating_bounds_.begin(), rating_bounds_.end(), rating);
+    if (bound != rating_bounds_.begin()) {
+        ++rating_counts_[bound - rating_bounds_.begin() - 1];
+    }
+}
+
+void FacetCounts::Merge(const FacetCounts& other) {
+    hit_count_ += other.hit_count_;
+    for (size_t i = 0; i < DOCUMENT_STATUS_COUNT; ++i) {
+        status_counts_[i] += other.status_counts_[i];
+    }
+    for (size_t i = 0; i < rating_counts_.size(); ++i) {
+        rating_counts_[i] += other.rating_counts_[i];
+    }
+}
+
+void FacetCounts::Reset() {
+    hit_count_ = 0;
+    status_counts_.fill(0);
+    std::fill(rating_counts_.begin(), rating_counts_.end(), 0);
+}
+
+size_t FacetCounts::GetHitCount() const {
+    return hit_count_;
+}
+
+size_t FacetCounts::GetMatchCount() const {
+    return std::accumulate(status_counts_.begin(), status_counts_.end(), size_t{0});
+}
+
+size_t FacetCounts::GetStatusCount(const DocumentStatus& status) const {
+    return status_counts_[static_cast<size_t>(status)];
+}
+
+const std::vector<int>& FacetCounts::GetRatingBounds() const {
+    return rating_bounds_;
+}
+
+const std::vector<size_t>& FacetCounts::GetRatingCounts() const {
+    return rating_counts_;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "document.h"
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// Matches of a query by status and by rating bucket, hits are those its predicate takes. Bucket i holds ratings
+// in [rating_bounds[i], rating_bounds[i + 1]), the last one is open-ended.
+class FacetCounts {
+public:
+    FacetCounts() = default;
+    // The bounds must be sorted
+    explicit FacetCounts(std::vector<int> rating_bounds);
+
+    void Add(const DocumentStatus& status, int rating, bool is_hit);
+    // The bounds must be the same
+    void Merge(const FacetCounts& other);
+    void Reset();
+
+    size_t GetHitCount() const;
+    size_t GetMatchCount() const;
+    size_t GetStatusCount(const DocumentStatus& status) const;
+    const std::vector<int>& GetRatingBounds() const;
+    const std::vector<size_t>& GetRatingCounts() const;
+
+private:
+    std::vector<int> rating_bounds_;
+    size_t hit_count_ = 0;
+    std::array<size_t, DOCUMENT_STATUS_COUNT> status_counts_{};
+    std::vector<size_t> rating_counts_;
+};
@@ -0,0 +1,314 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Exponential search for the first of values[position, size) not less than value
+size_t GallopTo(const int* values, size_t position, size_t size, int value) {
+    if (position >= size) {
+        return size;
+    }
+    size_t step = 1;
+    while (position + step < size && values[position + step] < value) {
+        position += step;
+        step *= 2;
+    }
+    return std::lower_bound(values + position, values + std::min(position + step + 1, size), value) - values;
+}
+
+} // namespace
+
+size_t SkipTo(const PostingList& postings, size_t position, int internal_id) {
+    if (postings.skip_ids == nullptr || position >= postings.size) {
+        return GallopTo(postings.internal_ids, position, postings.size, internal_id);
+    }
+    // The last block that starts at or before internal_id holds the answer, unless it is the start of the next one
+    const size_t block_count = (postings.size + SKIP_INTERVAL - 1) / SKIP_INTERVAL;
+    const size_t next_block = GallopTo(postings.skip_ids, position / SKIP_INTERVAL + 1, block_count, internal_id + 1);
+    const size_t first = std::max(position, (next_block - 1) * SKIP_INTERVAL);
+    const size_t last = std::min(next_block * SKIP_INTERVAL, postings.size);
+    return std::lower_bound(postings.internal_ids + first, postings.internal_ids + last, internal_id) - postings.internal_ids;
+}
+
+MutableSegment::MutableSegment(int first_internal_id, std::pmr::memory_resource* resource)
+: first_internal_id_(first_internal_id)
+, last_internal_id_(first_internal_id)
+, term_postings_(resource)
+{
+}
+
+void MutableSegment::AddDocument(int internal_id, const TermFrequency* first, const TermFrequency* last) {
+    for (const TermFrequency* entry = first; entry != last; ++entry) {
+        Postings& postings = term_postings_.try_emplace(entry->term_id, term_postings_.get_allocator().resource()).first->second;
+        postings.internal_ids.push_back(internal_id);
+        postings.term_freqs.push_back(entry->term_freq);
+    }
+    last_internal_id_ = internal_id + 1;
+}
+
+PostingList MutableSegment::GetPostings(int term_id) const {
+    const auto it = term_postings_.find(term_id);
+    if (it == term_postings_.end()) {
+        return {};
+    }
+    return {it->second.internal_ids.data(), it->second.term_freqs.data(), it->second.internal_ids.size()};
+}
+
+int MutableSegment::GetFirstInternalId() const {
+    return first_internal_id_;
+}
+
+int MutableSegment::GetLastInternalId() const {
+    return last_internal_id_;
+}
+
+size_t MutableSegment::GetDocumentCount() const {
+    return last_internal_id_ - first_internal_id_;
+}
+
+IndexSegment::IndexSegment(int first_internal_id, int last_internal_id, size_t tier, std::pmr::memory_resource* resource)
+: first_internal_id_(first_internal_id)
+, last_internal_id_(last_internal_id)
+, tier_(tier)
+, term_ids_(resource)
+, posting_offsets_(1, 0, resource)
+, internal_ids_(resource)
+, term_freqs_(resource)
+, skip_offsets_(1, 0, resource)
+, skip_ids_(resource)
+{
+}
+
+std::shared_ptr<const IndexSegment> IndexSegment::Seal(const MutableSegment& segment,
+                                                       const std::vector<char>& is_removed,
+                                                       std::pmr::memory_resource* resource,
+                                                       size_t tier) {
+    std::shared_ptr<IndexSegment> sealed(new IndexSegment(segment.first_internal_id_, segment.last_internal_id_, tier, resource));
+
+    std::vector<int> term_ids;
+    term_ids.reserve(segment.term_postings_.size());
+    size_t posting_count = 0;
+    for (const auto& [term_id, postings] : segment.term_postings_) {
+        term_ids.push_back(term_id);
+        posting_count += postings.internal_ids.size();
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+
+    sealed->term_ids_.reserve(term_ids.size());
+    sealed->posting_offsets_.reserve(term_ids.size() + 1);
+    sealed->internal_ids_.reserve(posting_count);
+    sealed->term_freqs_.reserve(posting_count);
+    for (const int term_id : term_ids) {
+        sealed->AppendPostings(segment.GetPostings(term_id), is_removed);
+        sealed->FinishTerm(term_id);
+    }
+    return sealed;
+}
+
+std::shared_ptr<const IndexSegment> IndexSegment::Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                        const std::vector<char>& is_removed,
+                                                        std::pmr::memory_resource* resource) {
+    // Capacity is reserved for the live postings only, the merged segment keeps it as long as it lives
+    size_t tier = 0;
+    size_t posting_count = 0;
+    const int first_internal_id = segments.front()->first_internal_id_;
+    for (const auto& segment : segments) {
+        tier = std::max(tier, segment->tier_ + 1);
+        for (const int internal_id : segment->internal_ids_) {
+            posting_count += is_removed[internal_id - first_internal_id] ? 0 : 1;
+        }
+    }
+    std::shared_ptr<IndexSegment> merged(new IndexSegment(segments.front()->first_internal_id_,
+                                                          segments.back()->last_internal_id_, tier, resource));
+    merged->internal_ids_.reserve(posting_count);
+    merged->term_freqs_.reserve(posting_count);
+
+    // Terms are taken in ascending order across all inputs, postings of a term follow the order of the segments
+    std::vector<size_t> positions(segments.size(), 0);
+    while (true) {
+        int term_id = -1;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (positions[i] < segments[i]->term_ids_.size()) {
+                const int candidate = segments[i]->term_ids_[positions[i]];
+                if (term_id < 0 || candidate < term_id) {
+                    term_id = candidate;
+                }
+            }
+        }
+        if (term_id < 0) {
+            break;
+        }
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (positions[i] < segments[i]->term_ids_.size() && segments[i]->term_ids_[positions[i]] == term_id) {
+                const IndexSegment& segment = *segments[i];
+                const size_t first = segment.posting_offsets_[positions[i]];
+                const size_t last = segment.posting_offsets_[positions[i] + 1];
+                merged->AppendPostings({segment.internal_ids_.data() + first, segment.term_freqs_.data() + first, last - first, nullptr}, is_removed);
+                ++positions[i];
+            }
+        }
+        merged->FinishTerm(term_id);
+    }
+    return merged;
+}
+
+void IndexSegment::AppendPostings(const PostingList& postings, const std::vector<char>& is_removed) {
+    for (size_t i = 0; i < postings.size; ++i) {
+        if (!is_removed[postings.internal_ids[i] - first_internal_id_]) {
+            internal_ids_.push_back(postings.internal_ids[i]);
+            term_freqs_.push_back(postings.term_freqs[i]);
+        }
+    }
+}
+
+void IndexSegment::FinishTerm(int term_id) {
+    // Terms whose documents are all removed are dropped
+    const size_t first = posting_offsets_.back();
+    if (internal_ids_.size() == first) {
+        return;
+    }
+    if (internal_ids_.size() - first > SKIP_INTERVAL) {
+        for (size_t position = first; position < internal_ids_.size(); position += SKIP_INTERVAL) {
+            skip_ids_.push_back(internal_ids_[position]);
+        }
+    }
+    term_ids_.push_back(term_id);
+    posting_offsets_.push_back(internal_ids_.size());
+    skip_offsets_.push_back(skip_ids_.size());
+}
+
+PostingList IndexSegment::GetPostings(int term_id) const {
+    const int term_index = FindTerm(term_id);
+    return term_index < 0 ? PostingList{} : GetPostingsAt(term_index);
+}
+
+int IndexSegment::FindTerm(int term_id) const {
+    const auto it = std::lower_bound(term_ids_.begin(), term_ids_.end(), term_id);
+    if (it == term_ids_.end() || *it != term_id) {
+        return -1;
+    }
+    return static_cast<int>(it - term_ids_.begin());
+}
+
+PostingList IndexSegment::GetPostingsAt(int term_index) const {
+    const size_t index = term_index;
+    const size_t first = posting_offsets_[index];
+    const int* const skip_ids = skip_offsets_[index] == skip_offsets_[index + 1] ? nullptr : skip_ids_.data() + skip_offsets_[index];
+    return {internal_ids_.data() + first, term_freqs_.data() + first, posting_offsets_[index + 1] - first, skip_ids};
+}
+
+int IndexSegment::GetFirstInternalId() const {
+    return first_internal_id_;
+}
+
+int IndexSegment::GetLastInternalId() const {
+    return last_internal_id_;
+}
+
+size_t IndexSegment::GetTier() const {
+    return tier_;
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return internal_ids_.size();
+}
+
+size_t IndexSegment::GetDeltaEncodedBits() const {
+    size_t bits = 0;
+    for (size_t index = 0; index < term_ids_.size(); ++index) {
+        int previous = first_internal_id_ - 1;
+        for (size_t position = posting_offsets_[index]; position < posting_offsets_[index + 1]; ++position) {
+            // A gap of n significant bits takes n - 1 zeros and the n bits themselves
+            const uint32_t gap = internal_ids_[position] - previous;
+            previous = internal_ids_[position];
+            bits += 2 * (32 - __builtin_clz(gap)) - 1;
+        }
+    }
+    return bits;
+}
+
+size_t IndexSegment::GetPostingOffset(const PostingList& postings) const {
+    return postings.internal_ids - internal_ids_.data();
+}
+
+const std::pmr::vector<int>& IndexSegment::GetTermIds() const {
+    return term_ids_;
+}
+
+std::shared_ptr<const SegmentImpacts> IndexSegment::GetImpacts() const {
+    return std::atomic_load(&impacts_);
+}
+
+void IndexSegment::SetImpacts(std::shared_ptr<const SegmentImpacts> impacts) const {
+    std::atomic_store(&impacts_, std::move(impacts));
+}
+
+SegmentImpacts::SegmentImpacts(ImpactPrecision precision, std::pmr::memory_resource* resource)
+: precision_(precision)
+, inverse_document_freqs_(resource)
+, impacts8_(resource)
+, impacts16_(resource)
+{
+}
+
+std::shared_ptr<const SegmentImpacts> SegmentImpacts::Compute(const IndexSegment& segment,
+                                                              ImpactPrecision precision,
+                                                              std::vector<double> inverse_document_freqs,
+                                                              std::pmr::memory_resource* resource) {
+    std::shared_ptr<SegmentImpacts> impacts(new SegmentImpacts(precision, resource));
+    impacts->inverse_document_freqs_.assign(inverse_document_freqs.begin(), inverse_document_freqs.end());
+
+    // One step for the whole segment keeps impacts of different terms additive
+    const std::pmr::vector<int>& term_ids = segment.GetTermIds();
+    double max_impact = 0.0;
+    for (size_t term_index = 0; term_index < term_ids.size(); ++term_index) {
+        const PostingList postings = segment.GetPostingsAt(static_cast<int>(term_index));
+        for (size_t i = 0; i < postings.size; ++i) {
+            max_impact = std::max(max_impact, postings.term_freqs[i] * inverse_document_freqs[term_index]);
+        }
+    }
+    const double max_level = precision == ImpactPrecision::BITS_8 ? std::numeric_limits<uint8_t>::max()
+                                                                  : std::numeric_limits<uint16_t>::max();
+    if (max_impact > 0.0) {
+        impacts->step_ = max_impact / max_level;
+    }
+
+    impacts->impacts8_.reserve(precision == ImpactPrecision::BITS_8 ? segment.GetPostingCount() : 0);
+    impacts->impacts16_.reserve(precision == ImpactPrecision::BITS_16 ? segment.GetPostingCount() : 0);
+    for (size_t term_index = 0; term_index < term_ids.size(); ++term_index) {
+        const PostingList postings = segment.GetPostingsAt(static_cast<int>(term_index));
+        for (size_t i = 0; i < postings.size; ++i) {
+            const double level = std::round(postings.term_freqs[i] * inverse_document_freqs[term_index] / impacts->step_);
+            if (precision == ImpactPrecision::BITS_8) {
+                impacts->impacts8_.push_back(static_cast<uint8_t>(level));
+            } else {
+                impacts->impacts16_.push_back(static_cast<uint16_t>(level));
+            }
+        }
+    }
+    return impacts;
+}
+
+ImpactPrecision SegmentImpacts::GetPrecision() const {
+    return precision_;
+}
+
+double SegmentImpacts::GetStep() const {
+    return step_;
+}
+
+double SegmentImpacts::GetInverseDocumentFreq(int term_index) const {
+    return inverse_document_freqs_[term_index];
+}
+
+const void* SegmentImpacts::GetImpacts(size_t posting_offset) const {
+    return precision_ == ImpactPrecision::BITS_8 ? static_cast<const void*>(impacts8_.data() + posting_offset)
+                                                 : static_cast<const void*>(impacts16_.data() + posting_offset);
+}
+
+bool IsImpactFresh(double stored_idf, double idf) {
+    return std::abs(idf - stored_idf) <= IMPACT_REFRESH_THRESHOLD * stored_idf;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "word_frequencies.h"
+
+const size_t MUTABLE_SEGMENT_DOCUMENT_COUNT = 4096;
+const size_t SEGMENT_MERGE_FACTOR = 4;
+const size_t SKIP_INTERVAL = 64;
+// Relative drift of the IDF past which impacts are stale
+const double IMPACT_REFRESH_THRESHOLD = 0.05;
+
+enum class ImpactPrecision {
+    NONE,
+    BITS_8,
+    BITS_16,
+};
+
+struct PostingList {
+    const int* internal_ids = nullptr;
+    const double* term_freqs = nullptr;
+    size_t size = 0;
+    // Every SKIP_INTERVAL-th internal id, nullptr for short and mutable lists
+    const int* skip_ids = nullptr;
+};
+
+// Position of the first posting at or after position whose internal id is not less than internal_id
+size_t SkipTo(const PostingList& postings, size_t position, int internal_id);
+
+// Documents come in ascending order of internal ids
+class MutableSegment {
+public:
+    explicit MutableSegment(int first_internal_id, std::pmr::memory_resource* resource);
+
+    void AddDocument(int internal_id, const TermFrequency* first, const TermFrequency* last);
+
+    PostingList GetPostings(int term_id) const;
+
+    int GetFirstInternalId() const;
+    int GetLastInternalId() const;
+    size_t GetDocumentCount() const;
+
+private:
+    friend class IndexSegment;
+
+    struct Postings {
+        explicit Postings(std::pmr::memory_resource* resource)
+        : internal_ids(resource)
+        , term_freqs(resource)
+        {
+        }
+
+        std::pmr::vector<int> internal_ids;
+        std::pmr::vector<double> term_freqs;
+    };
+
+    int first_internal_id_;
+    int last_internal_id_;
+    std::pmr::unordered_map<int, Postings> term_postings_;
+};
+
+class SegmentImpacts;
+
+// Postings never change, removed documents are skipped by queries and dropped by the next merge
+class IndexSegment {
+public:
+    // is_removed is indexed by internal id minus the first internal id of the segment
+    static std::shared_ptr<const IndexSegment> Seal(const MutableSegment& segment,
+                                                    const std::vector<char>& is_removed,
+                                                    std::pmr::memory_resource* resource,
+                                                    size_t tier = 0);
+    // Segments have adjacent internal id ranges and are listed in ascending order
+    static std::shared_ptr<const IndexSegment> Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                     const std::vector<char>& is_removed,
+                                                     std::pmr::memory_resource* resource);
+
+    PostingList GetPostings(int term_id) const;
+    // Index of the term among GetTermIds(), or -1
+    int FindTerm(int term_id) const;
+    PostingList GetPostingsAt(int term_index) const;
+    size_t GetPostingOffset(const PostingList& postings) const;
+    const std::pmr::vector<int>& GetTermIds() const;
+
+    int GetFirstInternalId() const;
+    int GetLastInternalId() const;
+    size_t GetTier() const;
+    size_t GetPostingCount() const;
+    // Elias gamma codes of the gaps between internal ids
+    size_t GetDeltaEncodedBits() const;
+
+    // The only part replaced after sealing, queries may read them while the writer replaces them
+    std::shared_ptr<const SegmentImpacts> GetImpacts() const;
+    void SetImpacts(std::shared_ptr<const SegmentImpacts> impacts) const;
+
+private:
+    int first_internal_id_;
+    int last_internal_id_;
+    size_t tier_;
+    std::pmr::vector<int> term_ids_;
+    std::pmr::vector<size_t> posting_offsets_;
+    std::pmr::vector<int> internal_ids_;
+    std::pmr::vector<double> term_freqs_;
+    std::pmr::vector<size_t> skip_offsets_;
+    std::pmr::vector<int> skip_ids_;
+    mutable std::shared_ptr<const SegmentImpacts> impacts_;
+
+    IndexSegment(int first_internal_id, int last_internal_id, size_t tier, std::pmr::memory_resource* resource);
+
+    void AppendPostings(const PostingList& postings, const std::vector<char>& is_removed);
+    void FinishTerm(int term_id);
+};
+
+// Quantized term_freq * IDF of every posting of a sealed segment, impact q stands for q * GetStep()
+class SegmentImpacts {
+public:
+    // inverse_document_freqs are in the order of GetTermIds()
+    static std::shared_ptr<const SegmentImpacts> Compute(const IndexSegment& segment,
+                                                         ImpactPrecision precision,
+                                                         std::vector<double> inverse_document_freqs,
+                                                         std::pmr::memory_resource* resource);
+
+    ImpactPrecision GetPrecision() const;
+    double GetStep() const;
+    double GetInverseDocumentFreq(int term_index) const;
+    // uint8_t or uint16_t by the precision
+    const void* GetImpacts(size_t posting_offset) const;
+
+private:
+    ImpactPrecision precision_;
+    double step_ = 1.0;
+    std::pmr::vector<double> inverse_document_freqs_;
+    std::pmr::vector<uint8_t> impacts8_;
+    std::pmr::vector<uint16_t> impacts16_;
+
+    SegmentImpacts(ImpactPrecision precision, std::pmr::memory_resource* resource);
+};
+
+bool IsImpactFresh(double stored_idf, double idf);
@@ -0,0 +1,183 @@
+#include "load_client.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+QueryClient::QueryClient(const std::string& address, uint16_t port) {
+    socket_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) {
+        throw std::runtime_error("Can't create a socket");
+    }
+    sockaddr_in socket_address{};
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1
+        || connect(socket_, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) != 0) {
+        close(socket_);
+        throw std::runtime_error("Can't connect to " + address + ":" + std::to_string(port));
+    }
+    const int no_delay = 1;
+    setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+}
+
+QueryClient::~QueryClient() {
+    close(socket_);
+}
+
+void QueryClient::Send(std::string_view request) {
+    std::string line(request);
+    line.push_back('\n');
+    size_t offset = 0;
+    while (offset < line.size()) {
+        const ssize_t count = send(socket_, line.data() + offset, line.size() - offset, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("Connection is broken");
+        }
+        offset += count;
+    }
+}
+
+std::string QueryClient::Receive() {
+    while (true) {
+        const size_t newline = input_.find('\n', input_offset_);
+        if (newline != input_.npos) {
+            std::string line = input_.substr(input_offset_, newline - input_offset_);
+            input_offset_ = newline + 1;
+            if (input_offset_ * 2 > input_.size()) {
+                input_.erase(0, input_offset_);
+                input_offset_ = 0;
+            }
+            return line;
+        }
+        char buffer[16 * 1024];
+        const ssize_t count = recv(socket_, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("Connection is closed");
+        }
+        input_.append(buffer, count);
+    }
+}
+
+LoadReport RunLoad(const std::string& address, uint16_t port, const std::vector<std::string>& requests,
+                   size_t connection_count, size_t pipeline_depth) {
+    using Clock = std::chrono::steady_clock;
+    connection_count = std::max<size_t>(connection_count, 1);
+    std::vector<std::vector<double>> latencies(connection_count);
+    std::vector<size_t> error_counts(connection_count, 0);
+    std::vector<std::exception_ptr> failures(connection_count);
+
+    auto run_connection = [&](size_t index) {
+        QueryClient client(address, port);
+        // Send times of the requests in flight
+        std::deque<Clock::time_point> sent;
+        size_t next = index;
+        while (next < requests.size() || !sent.empty()) {
+            while (next < requests.size() && sent.size() < pipeline_depth) {
+                client.Send(requests[next]);
+                sent.push_back(Clock::now());
+                next += connection_count;
+            }
+            const std::string response = client.Receive();
+            latencies[index].push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent.front()).count());
+            sent.pop_front();
+            error_counts[index] += response.rfind("ERROR", 0) == 0 ? 1 : 0;
+        }
+    };
+
+    // A thread of its own sends all requests, so the responses pile up on the server while they are read
+    auto run_unbounded_connection = [&](size_t index) {
+        QueryClient client(address, port);
+        const size_t request_count = index < requests.size() ? (requests.size() - index - 1) / connection_count + 1 : 0;
+        std::vector<Clock::time_point> send_times;
+        send_times.reserve(request_count);
+        std::exception_ptr send_failure;
+        std::thread sender([&] {
+            try {
+                for (size_t next = index; next < requests.size(); next += connection_count) {
+                    send_times.push_back(Clock::now());
+                    client.Send(requests[next]);
+                }
+            } catch (...) {
+                send_failure = std::current_exception();
+            }
+        });
+        std::vector<Clock::time_point> receive_times;
+        receive_times.reserve(request_count);
+        std::exception_ptr receive_failure;
+        try {
+            for (size_t i = 0; i < request_count; ++i) {
+                const std::string response = client.Receive();
+                receive_times.push_back(Clock::now());
+                error_counts[index] += response.rfind("ERROR", 0) == 0 ? 1 : 0;
+            }
+        } catch (...) {
+            receive_failure = std::current_exception();
+        }
+        sender.join();
+        for (const std::exception_ptr& failure : {send_failure, receive_failure}) {
+            if (failure != nullptr) {
+                std::rethrow_exception(failure);
+            }
+        }
+        for (size_t i = 0; i < request_count; ++i) {
+            latencies[index].push_back(std::chrono::duration<double, std::milli>(receive_times[i] - send_times[i]).count());
+        }
+    };
+
+    const Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t index = 0; index < connection_count; ++index) {
+        threads.emplace_back([&, index] {
+            try {
+                if (pipeline_depth == 0) {
+                    run_unbounded_connection(index);
+                } else {
+                    run_connection(index);
+                }
+            } catch (...) {
+                failures[index] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const std::exception_ptr& failure : failures) {
+        if (failure != nullptr) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    LoadReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::vector<double> all_latencies;
+    for (size_t index = 0; index < connection_count; ++index) {
+        all_latencies.insert(all_latencies.end(), latencies[index].begin(), latencies[index].end());
+        report.error_count += error_counts[index];
+    }
+    report.request_count = all_latencies.size();
+    if (!all_latencies.empty()) {
+        std::sort(all_latencies.begin(), all_latencies.end());
+        report.median_latency = all_latencies[all_latencies.size() / 2];
+        report.p99_latency = all_latencies[all_latencies.size() * 99 / 100];
+        report.max_latency = all_latencies.back();
+    }
+    return report;
+}
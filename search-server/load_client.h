@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Blocking connection to a QueryServer. One thread may send while another one receives.
+class QueryClient {
+public:
+    QueryClient(const std::string& address, uint16_t port);
+    ~QueryClient();
+
+    QueryClient(const QueryClient&) = delete;
+    QueryClient& operator=(const QueryClient&) = delete;
+
+    // Throw std::runtime_error if the connection is broken
+    void Send(std::string_view request);
+    std::string Receive();
+
+private:
+    int socket_ = -1;
+    std::string input_;
+    size_t input_offset_ = 0;
+};
+
+struct LoadReport {
+    size_t request_count = 0;
+    size_t error_count = 0;
+    double seconds = 0.0;
+    // Milliseconds
+    double median_latency = 0.0;
+    double p99_latency = 0.0;
+    double max_latency = 0.0;
+};
+
+// Closed-loop load, every connection keeps up to pipeline_depth requests in flight.
+// With pipeline_depth 0 every connection sends all its requests without waiting for the responses.
+LoadReport RunLoad(const std::string& address, uint16_t port, const std::vector<std::string>& requests,
+                   size_t connection_count, size_t pipeline_depth);
@@ -0,0 +1,42 @@
+#include "load_client.h"
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Usage: load_client <requests file> [port] [connections] [pipeline depth] [address]
+// Sends every line of the file as a request, e.g. "FIND<TAB>пушистый кот", and prints throughput and latency.
+// Pipeline depth 0 sends all requests without waiting for the responses, which makes the server hold back reading.
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: load_client <requests file> [port] [connections] [pipeline depth] [address]"s << endl;
+        return 1;
+    }
+    try {
+        ifstream input(argv[1]);
+        vector<string> requests;
+        for (string line; getline(input, line);) {
+            if (!line.empty()) {
+                requests.push_back(line);
+            }
+        }
+        const uint16_t port = argc > 2 ? static_cast<uint16_t>(stoi(argv[2])) : 8080;
+        const size_t connection_count = argc > 3 ? stoul(argv[3]) : 4;
+        const size_t pipeline_depth = argc > 4 ? stoul(argv[4]) : 16;
+        const string address = argc > 5 ? argv[5] : "127.0.0.1"s;
+
+        const LoadReport report = RunLoad(address, port, requests, connection_count, pipeline_depth);
+        cout << report.request_count << " requests, "s << report.error_count << " errors in "s << report.seconds << " s: "s
+             << report.request_count / report.seconds << " requests/s"s << endl;
+        cout << "latency median "s << report.median_latency << " ms, p99 "s << report.p99_latency << " ms, max "s
+             << report.max_latency << " ms"s << endl;
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
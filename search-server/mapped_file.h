@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file can't be mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view GetText() const;
+
+    // Pages are read back from the file if touched again
+    void Release(size_t first, size_t last) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
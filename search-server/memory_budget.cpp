@@ -0,0 +1,13 @@
+#include "memory_budget.h"
+
+#include <string>
+
+size_t MemoryStats::GetTotal() const {
+    return words + forward_index + documents + ids + champion_lists + rating_index + mutable_segment + sealed_segments;
+}
+
+MemoryBudgetExceeded::MemoryBudgetExceeded(size_t bytes_in_use, size_t limit)
+: std::runtime_error("Memory budget exceeded: the index holds " + std::to_string(bytes_in_use) + " bytes of "
+                     + std::to_string(limit))
+{
+}
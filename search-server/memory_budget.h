@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+
+// Bytes the structures of a SearchServer hold, as the counters of their allocators see them
+struct MemoryStats {
+    // Stop words, the term dictionary and the document frequencies
+    size_t words = 0;
+    size_t forward_index = 0;
+    size_t documents = 0;
+    size_t ids = 0;
+    size_t champion_lists = 0;
+    size_t rating_index = 0;
+    size_t mutable_segment = 0;
+    // Segments being merged included
+    size_t sealed_segments = 0;
+
+    size_t GetTotal() const;
+};
+
+enum class MemoryBudgetPolicy {
+    // Throws MemoryBudgetExceeded
+    REJECT,
+    // Waits for the merges in flight, and if that isn't enough, for throttle_delay before it throws
+    THROTTLE,
+};
+
+// Over the limit the index is compacted first if documents were removed since the last compaction
+struct MemoryBudget {
+    // 0 for no limit
+    size_t limit = 0;
+    MemoryBudgetPolicy policy = MemoryBudgetPolicy::REJECT;
+    std::chrono::microseconds throttle_delay{1000};
+};
+
+class MemoryBudgetExceeded : public std::runtime_error {
+public:
+    MemoryBudgetExceeded(size_t bytes_in_use, size_t limit);
+};
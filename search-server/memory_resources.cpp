@@ -0,0 +1,42 @@
+#include "memory_resources.h"
+
+CountingResource::CountingResource(std::pmr::memory_resource* upstream)
+: upstream_(upstream)
+{
+}
+
+size_t CountingResource::GetAllocationCount() const {
+    return allocation_count_;
+}
+
+size_t CountingResource::GetBytesInUse() const {
+    return bytes_in_use_;
+}
+
+size_t CountingResource::GetPeakBytesInUse() const {
+    return peak_bytes_in_use_;
+}
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void* p = upstream_->allocate(bytes, alignment);
+    ++allocation_count_;
+    const size_t in_use = bytes_in_use_ += bytes;
+    size_t peak = peak_bytes_in_use_;
+    while (in_use > peak && !peak_bytes_in_use_.compare_exchange_weak(peak, in_use)) {
+    }
+    return p;
+}
+
+void CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    upstream_->deallocate(p, bytes, alignment);
+    bytes_in_use_ -= bytes;
+}
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+QueryArena::QueryArena()
+: std::pmr::monotonic_buffer_resource(buffer.data(), buffer.size())
+{
+}
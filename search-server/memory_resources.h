@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+const size_t QUERY_ARENA_BUFFER_SIZE = 16 * 1024;
+
+// Forwards to the upstream resource and counts what goes through it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+    size_t GetAllocationCount() const;
+    size_t GetBytesInUse() const;
+    size_t GetPeakBytesInUse() const;
+
+private:
+    std::pmr::memory_resource* upstream_;
+    std::atomic<size_t> allocation_count_ = 0;
+    std::atomic<size_t> bytes_in_use_ = 0;
+    std::atomic<size_t> peak_bytes_in_use_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Listed before the resource among the bases of QueryArena, so the buffer is constructed first
+struct QueryArenaBuffer {
+    alignas(std::max_align_t) std::array<std::byte, QUERY_ARENA_BUFFER_SIZE> buffer;
+};
+
+// Temporaries of one request. Not thread-safe, parallel tasks allocate from arenas of their own.
+class QueryArena : private QueryArenaBuffer, public std::pmr::monotonic_buffer_resource {
+public:
+    QueryArena();
+
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+};
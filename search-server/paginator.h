@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <type_traits>
 #include <vector>
 
 template <typename Iterator>
@@ -76,7 +79,7 @@ private:
     void FillPages() {
         size_t count_pages = std::distance(first_, last_) / size_page_;
         bool last_full = true;
-        if (count_pages * size_page_ != std::distance(first_, last_)) {
+        if (count_pages * size_page_ != static_cast<size_t>(std::distance(first_, last_))) {
             last_full = false;
         }
         Iterator begin_page = first_;
@@ -99,4 +102,102 @@ private:
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
-}
\ No newline at end of file
+}
+
+// Moves it forward by count positions, but not past last
+template <typename Iterator>
+Iterator AdvanceAtMost(Iterator it, Iterator last, size_t count) {
+    using Category = typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, Category>) {
+        return it + std::min<size_t>(count, last - it);
+    } else {
+        for (; count > 0 && it != last; --count) {
+            ++it;
+        }
+        return it;
+    }
+}
+
+// Finds the bounds of a page when it is reached, in constant time for random access ranges
+template <typename Iterator>
+class LazyPaginator {
+public:
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        PageIterator(Iterator begin_page, Iterator last, size_t size_page)
+        : begin_page_(begin_page)
+        , last_(last)
+        , size_page_(size_page)
+        {
+        }
+
+        value_type operator*() const {
+            return {begin_page_, AdvanceAtMost(begin_page_, last_, size_page_)};
+        }
+
+        PageIterator& operator++() {
+            begin_page_ = AdvanceAtMost(begin_page_, last_, size_page_);
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            PageIterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return begin_page_ == other.begin_page_;
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Iterator begin_page_;
+        Iterator last_;
+        size_t size_page_;
+    };
+
+    LazyPaginator(Iterator first, Iterator last, size_t size_page)
+    : first_(first)
+    , last_(last)
+    , size_page_(size_page)
+    {
+    }
+
+    PageIterator begin() const {
+        return {first_, last_, size_page_};
+    }
+
+    PageIterator end() const {
+        return {last_, last_, size_page_};
+    }
+
+    int size() const {
+        return (std::distance(first_, last_) + size_page_ - 1) / size_page_;
+    }
+
+    // Page number index, counted from zero
+    IteratorRange<Iterator> operator[](size_t index) const {
+        const Iterator begin_page = AdvanceAtMost(first_, last_, index * size_page_);
+        return {begin_page, AdvanceAtMost(begin_page, last_, size_page_)};
+    }
+
+private:
+    Iterator first_;
+    Iterator last_;
+    size_t size_page_;
+};
+
+template <typename Container>
+auto PaginateLazily(const Container& c, size_t page_size) {
+    return LazyPaginator(begin(c), end(c), page_size);
+}
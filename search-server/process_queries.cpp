@@ -1,17 +1,14 @@
 #include "process_queries.h"
-#include <execution>
-#include <algorithm>
 
 std::vector<std::vector<Document>> ProcessQueries(
         const SearchServer& search_server,
         const std::vector<std::string>& queries) {
 
+    // Shares the pool with parallel queries, so both kinds of parallelism use one set of threads
     std::vector<std::vector<Document>> documents_lists(queries.size());
-    std::transform(std::execution::par,
-                   queries.begin(), queries.end(),
-                   documents_lists.begin(),
-                   [&search_server](const auto& query) {return search_server.FindTopDocuments(query); }
-    );
+    search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t index) {
+        documents_lists[index] = search_server.FindTopDocuments(queries[index]);
+    });
     return documents_lists;
 }
 
@@ -0,0 +1,44 @@
+#include "query_budget.h"
+
+QueryBudget& QueryBudget::SetDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    return *this;
+}
+
+QueryBudget& QueryBudget::SetTimeout(Clock::duration timeout) {
+    return SetDeadline(Clock::now() + timeout);
+}
+
+QueryBudget& QueryBudget::SetMaxPostings(size_t max_postings) {
+    max_postings_ = max_postings;
+    return *this;
+}
+
+void QueryBudget::Cancel() {
+    is_cancelled_.store(true, std::memory_order_relaxed);
+    is_exhausted_.store(true, std::memory_order_relaxed);
+}
+
+bool QueryBudget::IsCancelled() const {
+    return is_cancelled_.load(std::memory_order_relaxed);
+}
+
+bool QueryBudget::Charge(size_t postings) {
+    if (is_exhausted_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    const size_t spent_postings = spent_postings_.fetch_add(postings, std::memory_order_relaxed) + postings;
+    if (spent_postings > max_postings_ || Clock::now() >= deadline_) {
+        is_exhausted_.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool QueryBudget::IsExhausted() const {
+    return is_exhausted_.load(std::memory_order_relaxed);
+}
+
+size_t QueryBudget::GetSpentPostings() const {
+    return spent_postings_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+
+const size_t BUDGET_CHECK_INTERVAL = 1024;
+
+// Checked every BUDGET_CHECK_INTERVAL postings of a scoring task. Serves one request and isn't reset.
+class QueryBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryBudget() = default;
+    QueryBudget(const QueryBudget&) = delete;
+    QueryBudget& operator=(const QueryBudget&) = delete;
+
+    QueryBudget& SetDeadline(Clock::time_point deadline);
+    QueryBudget& SetTimeout(Clock::duration timeout);
+    QueryBudget& SetMaxPostings(size_t max_postings);
+
+    // May be called from any thread while the request runs
+    void Cancel();
+    bool IsCancelled() const;
+
+    // False once a limit is reached
+    bool Charge(size_t postings);
+    // The result is partial then
+    bool IsExhausted() const;
+    size_t GetSpentPostings() const;
+
+private:
+    Clock::time_point deadline_ = Clock::time_point::max();
+    size_t max_postings_ = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> spent_postings_ = 0;
+    std::atomic<bool> is_cancelled_ = false;
+    std::atomic<bool> is_exhausted_ = false;
+};
+
+// Charges a budget in blocks of BUDGET_CHECK_INTERVAL postings, budget may be nullptr
+class BudgetMeter {
+public:
+    explicit BudgetMeter(QueryBudget* budget)
+    : budget_(budget)
+    {
+    }
+
+    bool Add(size_t postings) {
+        if (budget_ == nullptr) {
+            return true;
+        }
+        unbilled_postings_ += postings;
+        if (unbilled_postings_ < BUDGET_CHECK_INTERVAL) {
+            return true;
+        }
+        const size_t postings_to_charge = unbilled_postings_;
+        unbilled_postings_ = 0;
+        return budget_->Charge(postings_to_charge);
+    }
+
+    bool IsExhausted() const {
+        return budget_ != nullptr && budget_->IsExhausted();
+    }
+
+private:
+    QueryBudget* budget_;
+    size_t unbilled_postings_ = 0;
+};
@@ -0,0 +1,68 @@
+#include "query_explain.h"
+
+#include <algorithm>
+
+namespace {
+
+const char* GetPathName(const QueryExplain& explain) {
+    if (explain.is_champion_path) {
+        return "champion lists";
+    }
+    switch (explain.path) {
+        case ExecutionPath::SEQUENTIAL:
+            return "sequential";
+        case ExecutionPath::PARALLEL_SEGMENTS:
+            return "parallel segments";
+        default:
+            return "parallel chunks";
+    }
+}
+
+double ToMicroseconds(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::micro>(time).count();
+}
+
+} // namespace
+
+ExplainCounters::ExplainCounters(size_t plus_word_count)
+: scanned_counts(plus_word_count, 0)
+{
+}
+
+void ExplainCounters::Merge(const ExplainCounters& other) {
+    scanned_counts.resize(std::max(scanned_counts.size(), other.scanned_counts.size()), 0);
+    for (size_t i = 0; i < other.scanned_counts.size(); ++i) {
+        scanned_counts[i] += other.scanned_counts[i];
+    }
+    matched_count += other.matched_count;
+    predicate_rejected_count += other.predicate_rejected_count;
+    minus_removed_count += other.minus_removed_count;
+    dense_range_count += other.dense_range_count;
+    merge_range_count += other.merge_range_count;
+    intersection_range_count += other.intersection_range_count;
+}
+
+std::ostream& operator<<(std::ostream& out, const QueryExplain& explain) {
+    out << "word\tpostings\tidf\tweight\tscanned" << std::endl;
+    for (const ExplainWord& word : explain.words) {
+        out << (word.is_minus ? "-" : word.is_required ? "+" : "") << word.word << '\t'
+            << word.posting_count << '\t' << word.inverse_document_freq << '\t';
+        if (word.is_minus) {
+            out << "-\t-";
+        } else {
+            out << word.weight << '\t' << word.scanned_count;
+        }
+        out << std::endl;
+    }
+    const ExplainCounters& counters = explain.counters;
+    out << "path " << GetPathName(explain) << ", segments " << explain.segment_count
+        << ", ranges dense " << counters.dense_range_count << " merge " << counters.merge_range_count
+        << " intersection " << counters.intersection_range_count
+        << (explain.is_filter_indexed ? ", filter indexed" : "") << std::endl;
+    out << "matched " << counters.matched_count << ", rejected by predicate " << counters.predicate_rejected_count
+        << ", removed by minus words " << counters.minus_removed_count << ", results " << explain.result_count << std::endl;
+    out << "parse " << ToMicroseconds(explain.parse_time) << " us, champion " << ToMicroseconds(explain.champion_time)
+        << " us, plan " << ToMicroseconds(explain.plan_time) << " us, score " << ToMicroseconds(explain.score_time)
+        << " us, merge " << ToMicroseconds(explain.merge_time) << " us" << std::endl;
+    return out;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "execution_plan.h"
+
+// Word of a parsed query. Prefix and fuzzy words appear as the indexed words they expanded into.
+struct ExplainWord {
+    std::string word;
+    bool is_minus = false;
+    bool is_required = false;
+    // Live documents only
+    size_t posting_count = 0;
+    double inverse_document_freq = 0.0;
+    // Below 1 for a fuzzy expansion
+    double weight = 1.0;
+    // Minus words are not counted
+    size_t scanned_count = 0;
+};
+
+// Every task of a parallel query counts on its own
+struct ExplainCounters {
+    ExplainCounters() = default;
+    explicit ExplainCounters(size_t plus_word_count);
+
+    void Merge(const ExplainCounters& other);
+
+    // Indexed like the plus words of the query
+    std::vector<size_t> scanned_counts;
+    // Documents the predicate saw
+    size_t matched_count = 0;
+    size_t predicate_rejected_count = 0;
+    size_t minus_removed_count = 0;
+    size_t dense_range_count = 0;
+    size_t merge_range_count = 0;
+    size_t intersection_range_count = 0;
+};
+
+struct QueryExplain {
+    // Plus words, then minus words
+    std::vector<ExplainWord> words;
+    // Set if the champion lists answered and no posting list was scanned
+    bool is_champion_path = false;
+    ExecutionPath path = ExecutionPath::SEQUENTIAL;
+    size_t segment_count = 0;
+    bool is_filter_indexed = false;
+    ExplainCounters counters;
+    size_t result_count = 0;
+
+    std::chrono::nanoseconds parse_time{0};
+    std::chrono::nanoseconds champion_time{0};
+    std::chrono::nanoseconds plan_time{0};
+    std::chrono::nanoseconds score_time{0};
+    std::chrono::nanoseconds merge_time{0};
+};
+
+// Does nothing without an explain record
+class ExplainTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ExplainTimer(QueryExplain* explain)
+    : explain_(explain)
+    {
+        if (explain_ != nullptr) {
+            stage_start_ = Clock::now();
+        }
+    }
+
+    void EndStage(std::chrono::nanoseconds QueryExplain::* stage) {
+        if (explain_ != nullptr) {
+            const Clock::time_point now = Clock::now();
+            explain_->*stage += std::chrono::duration_cast<std::chrono::nanoseconds>(now - stage_start_);
+            stage_start_ = now;
+        }
+    }
+
+private:
+    QueryExplain* explain_;
+    Clock::time_point stage_start_;
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryExplain& explain);
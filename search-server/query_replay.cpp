@@ -0,0 +1,154 @@
+#include "query_replay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <execution>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+double GetPercentile(const std::vector<double>& sorted_latencies, double fraction) {
+    if (sorted_latencies.empty()) {
+        return 0.0;
+    }
+    const size_t index = static_cast<size_t>(sorted_latencies.size() * fraction);
+    return sorted_latencies[std::min(index, sorted_latencies.size() - 1)];
+}
+
+} // namespace
+
+std::vector<LoggedQuery> ReadQueryLog(std::istream& input) {
+    std::vector<LoggedQuery> queries;
+    size_t line_number = 0;
+    for (std::string line; std::getline(input, line);) {
+        ++line_number;
+        if (line.empty()) {
+            continue;
+        }
+        const size_t tab = line.find('\t');
+        try {
+            if (tab == line.npos) {
+                throw std::invalid_argument("Missing field");
+            }
+            queries.push_back({line.substr(tab + 1), ParseDocumentStatus(std::string_view(line).substr(0, tab))});
+        } catch (const std::invalid_argument& error) {
+            throw std::invalid_argument("Query log line " + std::to_string(line_number) + ": " + error.what());
+        }
+    }
+    return queries;
+}
+
+std::vector<LoggedQuery> LoadQueryLog(const std::string& path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    return ReadQueryLog(input);
+}
+
+double ReplayReport::GetThroughput() const {
+    return seconds > 0.0 ? query_count / seconds : 0.0;
+}
+
+double ReplayReport::GetEmptyResultRate() const {
+    return query_count > 0 ? static_cast<double>(empty_result_count) / query_count : 0.0;
+}
+
+ReplayReport ReplayQueryLog(const SearchServer& search_server, const std::vector<LoggedQuery>& queries, const ReplayOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    if (options.mode == ReplayMode::OPEN_LOOP && options.target_qps <= 0.0) {
+        throw std::invalid_argument("Open-loop replay needs a target rate");
+    }
+    const size_t worker_count = std::max<size_t>(options.worker_count, 1);
+    std::vector<double> latencies(queries.size());
+    std::vector<char> is_empty(queries.size(), 0);
+    std::vector<char> is_error(queries.size(), 0);
+    std::vector<std::exception_ptr> failures(worker_count);
+    std::atomic<size_t> next_query = 0;
+
+    const Clock::time_point start = Clock::now();
+    auto run_worker = [&] {
+        for (size_t index = next_query++; index < queries.size(); index = next_query++) {
+            Clock::time_point sent = Clock::now();
+            if (options.target_qps > 0.0) {
+                const Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(index / options.target_qps));
+                std::this_thread::sleep_until(due);
+                sent = options.mode == ReplayMode::OPEN_LOOP ? due : Clock::now();
+            }
+            try {
+                is_empty[index] = search_server.FindTopDocuments(std::execution::seq, queries[index].raw_query, queries[index].status).empty();
+            } catch (const std::invalid_argument&) {
+                is_error[index] = 1;
+            }
+            latencies[index] = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t index = 0; index < worker_count; ++index) {
+        workers.emplace_back([&, index] {
+            try {
+                run_worker();
+            } catch (...) {
+                failures[index] = std::current_exception();
+                next_query = queries.size();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::exception_ptr& failure : failures) {
+        if (failure != nullptr) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    ReplayReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.query_count = queries.size();
+    report.empty_result_count = std::count(is_empty.begin(), is_empty.end(), 1);
+    report.error_count = std::count(is_error.begin(), is_error.end(), 1);
+    std::sort(latencies.begin(), latencies.end());
+    report.median_latency = GetPercentile(latencies, 0.5);
+    report.p99_latency = GetPercentile(latencies, 0.99);
+    report.p999_latency = GetPercentile(latencies, 0.999);
+    report.max_latency = latencies.empty() ? 0.0 : latencies.back();
+    return report;
+}
+
+void PrintReplayReport(std::ostream& output, const ReplayReport& report) {
+    output << report.query_count << " queries in " << report.seconds << " s: "
+           << report.GetThroughput() << " q/s, "
+           << "empty results " << 100.0 * report.GetEmptyResultRate() << "%, "
+           << "errors " << report.error_count << "; "
+           << "latency p50 " << report.median_latency << " ms, "
+           << "p99 " << report.p99_latency << " ms, "
+           << "p999 " << report.p999_latency << " ms, "
+           << "max " << report.max_latency << " ms" << std::endl;
+}
+
+void PrintReplayComparison(std::ostream& output, std::string_view first_name, const ReplayReport& first,
+                           std::string_view second_name, const ReplayReport& second) {
+    output << "metric\t" << first_name << '\t' << second_name << "\tratio" << std::endl;
+    auto print_row = [&output](std::string_view metric, double first_value, double second_value) {
+        output << metric << '\t' << first_value << '\t' << second_value << '\t';
+        if (first_value > 0.0) {
+            output << second_value / first_value;
+        } else {
+            output << '-';
+        }
+        output << std::endl;
+    };
+    print_row("q/s", first.GetThroughput(), second.GetThroughput());
+    print_row("p50 ms", first.median_latency, second.median_latency);
+    print_row("p99 ms", first.p99_latency, second.p99_latency);
+    print_row("p999 ms", first.p999_latency, second.p999_latency);
+    print_row("max ms", first.max_latency, second.max_latency);
+    print_row("empty %", 100.0 * first.GetEmptyResultRate(), 100.0 * second.GetEmptyResultRate());
+    print_row("errors", first.error_count, second.error_count);
+}
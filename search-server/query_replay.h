@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+struct LoggedQuery {
+    std::string raw_query;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+};
+
+// Reads lines "<status> TAB <query>", as RequestQueue records them. Throws std::invalid_argument on a malformed line.
+std::vector<LoggedQuery> ReadQueryLog(std::istream& input);
+std::vector<LoggedQuery> LoadQueryLog(const std::string& path);
+
+enum class ReplayMode {
+    CLOSED_LOOP,
+    // Queries are due at a fixed rate and their latency is counted from when they were due
+    OPEN_LOOP,
+};
+
+struct ReplayOptions {
+    ReplayMode mode = ReplayMode::CLOSED_LOOP;
+    size_t worker_count = 4;
+    // 0 sends queries as fast as the workers go
+    double target_qps = 0.0;
+};
+
+struct ReplayReport {
+    size_t query_count = 0;
+    size_t empty_result_count = 0;
+    size_t error_count = 0;
+    double seconds = 0.0;
+    // Milliseconds
+    double median_latency = 0.0;
+    double p99_latency = 0.0;
+    double p999_latency = 0.0;
+    double max_latency = 0.0;
+
+    double GetThroughput() const;
+    double GetEmptyResultRate() const;
+};
+
+// Throws std::invalid_argument if open loop has no target rate
+ReplayReport ReplayQueryLog(const SearchServer& search_server, const std::vector<LoggedQuery>& queries, const ReplayOptions& options);
+
+void PrintReplayReport(std::ostream& output, const ReplayReport& report);
+void PrintReplayComparison(std::ostream& output, std::string_view first_name, const ReplayReport& first,
+                           std::string_view second_name, const ReplayReport& second);
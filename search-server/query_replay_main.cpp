@@ -0,0 +1,78 @@
+#include "corpus_loader.h"
+#include "query_replay.h"
+#include "search_server.h"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Changes the configuration of a server with the loaded corpus
+void Configure(SearchServer& search_server, const string& configuration) {
+    if (configuration == "default"s) {
+        return;
+    }
+    if (configuration == "impacts8"s || configuration == "impacts16"s) {
+        search_server.SetImpactPrecision(configuration == "impacts8"s ? ImpactPrecision::BITS_8 : ImpactPrecision::BITS_16);
+        search_server.Compact();
+    } else if (configuration == "reordered"s) {
+        search_server.ReorderDocuments();
+    } else if (configuration == "no-champions"s) {
+        ExecutionThresholds thresholds = GetExecutionThresholds();
+        thresholds.use_champion_lists = false;
+        search_server.SetExecutionThresholds(thresholds);
+    } else {
+        throw invalid_argument("Unknown configuration "s + configuration);
+    }
+}
+
+ReplayReport Replay(const string& corpus_path, const string& configuration, const vector<LoggedQuery>& queries,
+                    const ReplayOptions& options) {
+    SearchServer search_server("и в на"s);
+    LoadCorpus(search_server, corpus_path);
+    Configure(search_server, configuration);
+    return ReplayQueryLog(search_server, queries, options);
+}
+
+} // namespace
+
+// Usage: query_replay <corpus file> <query log> [closed|open] [workers] [queries per second] [configuration] [configuration]
+// Replays a query log recorded by RequestQueue against the corpus, in the format of LoadCorpus. A configuration is
+// one of default, impacts8, impacts16, reordered, no-champions; with two of them the reports are compared.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: query_replay <corpus file> <query log> [closed|open] [workers] [queries per second] [configuration] [configuration]"s << endl;
+        return 1;
+    }
+    try {
+        const vector<LoggedQuery> queries = LoadQueryLog(argv[2]);
+        ReplayOptions options;
+        if (argc > 3) {
+            const string mode = argv[3];
+            if (mode != "closed"s && mode != "open"s) {
+                throw invalid_argument("Unknown mode "s + mode);
+            }
+            options.mode = mode == "open"s ? ReplayMode::OPEN_LOOP : ReplayMode::CLOSED_LOOP;
+        }
+        options.worker_count = argc > 4 ? stoul(argv[4]) : options.worker_count;
+        options.target_qps = argc > 5 ? stod(argv[5]) : options.target_qps;
+        const string first_configuration = argc > 6 ? argv[6] : "default"s;
+
+        const ReplayReport first = Replay(argv[1], first_configuration, queries, options);
+        if (argc > 7) {
+            const ReplayReport second = Replay(argv[1], argv[7], queries, options);
+            PrintReplayComparison(cout, first_configuration, first, argv[7], second);
+        } else {
+            PrintReplayReport(cout, first);
+        }
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
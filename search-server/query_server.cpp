@@ -0,0 +1,461 @@
+#include "query_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const int EPOLL_EVENT_COUNT = 64;
+
+// Cuts the next tab-separated field off the fields, the last field is the rest of them
+std::string_view TakeField(std::string_view& fields) {
+    const size_t tab = fields.find('\t');
+    const std::string_view field = fields.substr(0, tab);
+    fields.remove_prefix(tab == fields.npos ? fields.size() : tab + 1);
+    return field;
+}
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid number");
+    }
+    return value;
+}
+
+void AppendText(std::vector<char>& output, std::string_view text) {
+    output.insert(output.end(), text.begin(), text.end());
+}
+
+template <typename Number>
+void AppendNumber(std::vector<char>& output, Number number) {
+    char buffer[32];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    output.insert(output.end(), buffer, end);
+}
+
+} // namespace
+
+QueryServer::QueryServer(SearchServer& search_server, const std::string& address, uint16_t port)
+: search_server_(search_server)
+{
+    try {
+        listener_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener_ < 0) {
+            throw std::runtime_error("Can't create a socket");
+        }
+        const int reuse_address = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+        sockaddr_in socket_address{};
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1) {
+            throw std::runtime_error("Invalid address " + address);
+        }
+        if (bind(listener_, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) != 0
+            || listen(listener_, SOMAXCONN) != 0) {
+            throw std::runtime_error("Can't listen on " + address + ":" + std::to_string(port));
+        }
+        socklen_t address_size = sizeof(socket_address);
+        getsockname(listener_, reinterpret_cast<sockaddr*>(&socket_address), &address_size);
+        port_ = ntohs(socket_address.sin_port);
+
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_up_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        reserve_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (epoll_ < 0 || wake_up_ < 0 || reserve_ < 0) {
+            throw std::runtime_error("Can't create the event loop");
+        }
+        for (const int descriptor : {listener_, wake_up_}) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = descriptor;
+            epoll_ctl(epoll_, EPOLL_CTL_ADD, descriptor, &event);
+        }
+    } catch (...) {
+        CloseAll();
+        throw;
+    }
+}
+
+QueryServer::~QueryServer() {
+    CloseAll();
+}
+
+uint16_t QueryServer::GetPort() const {
+    return port_;
+}
+
+void QueryServer::Run() {
+    std::vector<epoll_event> events(EPOLL_EVENT_COUNT);
+    bool is_busy = false;
+    while (!is_stopped_) {
+        // Connections with requests left over from the last round don't wait for new events
+        const int event_count = epoll_wait(epoll_, events.data(), EPOLL_EVENT_COUNT, is_busy ? 0 : -1);
+        if (event_count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Event loop failed");
+        }
+        for (int i = 0; i < event_count; ++i) {
+            const int descriptor = events[i].data.fd;
+            if (descriptor == listener_) {
+                Accept();
+                continue;
+            }
+            if (descriptor == wake_up_) {
+                uint64_t count = 0;
+                [[maybe_unused]] const ssize_t size = read(wake_up_, &count, sizeof(count));
+                continue;
+            }
+            Connection& connection = *connections_.at(descriptor);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                Read(connection);
+            }
+            if (events[i].events & EPOLLOUT) {
+                Write(connection);
+            }
+        }
+
+        request_count_ = 0;
+        for (const auto& [socket, connection] : connections_) {
+            TakeRequests(*connection);
+        }
+        ExecuteRequests();
+        is_busy = false;
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if (FinishRound(*it->second)) {
+                is_busy = is_busy || HasRequests(*it->second);
+                ++it;
+            } else {
+                it = connections_.erase(it);
+            }
+        }
+    }
+}
+
+void QueryServer::Stop() {
+    is_stopped_ = true;
+    const uint64_t count = 1;
+    [[maybe_unused]] const ssize_t size = write(wake_up_, &count, sizeof(count));
+}
+
+void QueryServer::Accept() {
+    while (true) {
+        const int socket = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && reserve_ >= 0) {
+                close(reserve_);
+                const int rejected = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (rejected >= 0) {
+                    close(rejected);
+                }
+                reserve_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
+            }
+            // Out of memory, or no reserve descriptor: new connections wait until one of the open ones closes
+            SetListening(false);
+            return;
+        }
+        const int no_delay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        auto connection = std::make_unique<Connection>();
+        connection->socket = socket;
+        connection->events = EPOLLIN;
+        epoll_event event{};
+        event.events = connection->events;
+        event.data.fd = socket;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, socket, &event);
+        connections_.emplace(socket, std::move(connection));
+    }
+}
+
+void QueryServer::SetListening(bool is_listening) {
+    if (is_listening_ == is_listening) {
+        return;
+    }
+    is_listening_ = is_listening;
+    epoll_event event{};
+    event.events = is_listening ? static_cast<uint32_t>(EPOLLIN) : 0;
+    event.data.fd = listener_;
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, listener_, &event);
+}
+
+void QueryServer::Read(Connection& connection) {
+    while (!connection.is_closing && connection.input.size() - connection.input_offset < MAX_REQUEST_SIZE) {
+        const size_t size = connection.input.size();
+        connection.input.resize(size + READ_CHUNK_SIZE);
+        const ssize_t count = recv(connection.socket, connection.input.data() + size, READ_CHUNK_SIZE, 0);
+        connection.input.resize(size + std::max<ssize_t>(count, 0));
+        if (count > 0) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        // What a client sent before closing its side is still answered
+        connection.is_closing = true;
+        if (count < 0) {
+            connection.output.clear();
+            connection.output_offset = 0;
+        }
+    }
+}
+
+void QueryServer::Write(Connection& connection) {
+    while (connection.output_offset < connection.output.size()) {
+        const ssize_t count = send(connection.socket, connection.output.data() + connection.output_offset,
+                                   connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (count > 0) {
+            connection.output_offset += count;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else {
+            connection.is_closing = true;
+            connection.output_offset = connection.output.size();
+        }
+    }
+    connection.output.clear();
+    connection.output_offset = 0;
+}
+
+void QueryServer::TakeRequests(Connection& connection) {
+    if (connection.output.size() - connection.output_offset >= MAX_PENDING_OUTPUT_SIZE) {
+        return;
+    }
+    for (size_t taken = 0; taken < MAX_PIPELINED_REQUESTS; ++taken) {
+        const char* const first = connection.input.data() + connection.input_offset;
+        const size_t size = connection.input.size() - connection.input_offset;
+        const char* const newline = size == 0 ? nullptr : static_cast<const char*>(std::memchr(first, '\n', size));
+        if (newline == nullptr) {
+            if (size >= MAX_REQUEST_SIZE) {
+                AppendText(connection.output, "ERROR\tRequest is too long\n");
+                connection.input_offset = connection.input.size();
+                connection.is_closing = true;
+            }
+            return;
+        }
+        connection.input_offset = newline + 1 - connection.input.data();
+        std::string_view fields(first, newline - first);
+        if (!fields.empty() && fields.back() == '\r') {
+            fields.remove_suffix(1);
+        }
+
+        if (request_count_ == requests_.size()) {
+            requests_.emplace_back();
+        }
+        Request& request = requests_[request_count_++];
+        request.connection = &connection;
+        request.documents.clear();
+        request.error.clear();
+        const std::string_view command = TakeField(fields);
+        request.fields = fields;
+        if (command == "FIND") {
+            request.type = RequestType::FIND;
+        } else if (command == "MATCH") {
+            request.type = RequestType::MATCH;
+        } else if (command == "ADD") {
+            request.type = RequestType::ADD;
+        } else if (command == "REMOVE") {
+            request.type = RequestType::REMOVE;
+        } else {
+            request.type = RequestType::FIND;
+            request.error = "Unknown command";
+        }
+    }
+}
+
+void QueryServer::ExecuteRequests() {
+    auto is_change = [](const Request& request) {
+        return request.type == RequestType::ADD || request.type == RequestType::REMOVE;
+    };
+    size_t first = 0;
+    while (first < request_count_) {
+        size_t last = first;
+        while (last < request_count_ && !is_change(requests_[last])) {
+            ++last;
+        }
+        if (last == first) {
+            // Consecutive changes share one sync of the write-ahead log
+            while (last < request_count_ && is_change(requests_[last])) {
+                ++last;
+            }
+            try {
+                search_server_.RunWriteBatch([this, first, last] {
+                    for (size_t index = first; index < last; ++index) {
+                        ExecuteRequest(requests_[index]);
+                    }
+                });
+            } catch (const std::exception& error) {
+                for (size_t index = first; index < last; ++index) {
+                    if (requests_[index].error.empty()) {
+                        requests_[index].error = error.what();
+                    }
+                }
+            }
+        } else {
+            search_server_.GetThreadPool().ParallelFor(last - first, [this, first](size_t index) {
+                ExecuteRequest(requests_[first + index]);
+            });
+        }
+        for (size_t index = first; index < last; ++index) {
+            WriteResponse(requests_[index]);
+        }
+        first = last;
+    }
+}
+
+void QueryServer::ExecuteRequest(Request& request) {
+    if (!request.error.empty()) {
+        return;
+    }
+    try {
+        std::string_view fields = request.fields;
+        switch (request.type) {
+            case RequestType::FIND:
+                search_server_.FindTopDocuments(std::execution::seq, fields, request.documents);
+                break;
+            case RequestType::MATCH: {
+                const int document_id = ParseInt(TakeField(fields));
+                request.match = search_server_.MatchDocument(std::execution::seq, fields, document_id);
+                break;
+            }
+            case RequestType::ADD: {
+                const int document_id = ParseInt(TakeField(fields));
+                const DocumentStatus status = ParseDocumentStatus(TakeField(fields));
+                std::string_view ratings = TakeField(fields);
+                request.ratings.clear();
+                while (!ratings.empty()) {
+                    const size_t space = ratings.find(' ');
+                    const std::string_view rating = ratings.substr(0, space);
+                    ratings.remove_prefix(space == ratings.npos ? ratings.size() : space + 1);
+                    if (!rating.empty()) {
+                        request.ratings.push_back(ParseInt(rating));
+                    }
+                }
+                search_server_.AddDocument(document_id, fields, status, request.ratings);
+                break;
+            }
+            case RequestType::REMOVE:
+                search_server_.RemoveDocument(ParseInt(TakeField(fields)));
+                break;
+        }
+    } catch (const std::exception& error) {
+        request.error = error.what();
+    }
+}
+
+void QueryServer::WriteResponse(const Request& request) {
+    std::vector<char>& output = request.connection->output;
+    if (!request.error.empty()) {
+        AppendText(output, "ERROR\t");
+        AppendText(output, request.error);
+        output.push_back('\n');
+        return;
+    }
+    AppendText(output, "OK");
+    if (request.type == RequestType::FIND) {
+        for (const Document& document : request.documents) {
+            output.push_back('\t');
+            AppendNumber(output, document.id);
+            output.push_back(' ');
+            AppendNumber(output, document.relevance);
+            output.push_back(' ');
+            AppendNumber(output, document.rating);
+        }
+    } else if (request.type == RequestType::MATCH) {
+        const auto& [words, status] = request.match;
+        output.push_back('\t');
+        AppendText(output, GetDocumentStatusName(status));
+        output.push_back('\t');
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (i > 0) {
+                output.push_back(' ');
+            }
+            AppendText(output, words[i]);
+        }
+    }
+    output.push_back('\n');
+}
+
+bool QueryServer::FinishRound(Connection& connection) {
+    connection.input.erase(connection.input.begin(), connection.input.begin() + connection.input_offset);
+    connection.input_offset = 0;
+    Write(connection);
+    const size_t pending_output_size = connection.output.size() - connection.output_offset;
+    if (connection.is_closing && pending_output_size == 0 && !HasRequests(connection)) {
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, connection.socket, nullptr);
+        close(connection.socket);
+        if (reserve_ < 0) {
+            reserve_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        SetListening(true);
+        return false;
+    }
+
+    uint32_t events = 0;
+    if (!connection.is_closing && pending_output_size < MAX_PENDING_OUTPUT_SIZE && connection.input.size() < MAX_REQUEST_SIZE) {
+        events |= EPOLLIN;
+    }
+    if (pending_output_size > 0) {
+        events |= EPOLLOUT;
+    }
+    UpdateEvents(connection, events);
+    return true;
+}
+
+bool QueryServer::HasRequests(const Connection& connection) {
+    const size_t size = connection.input.size() - connection.input_offset;
+    return size > 0 && connection.output.size() - connection.output_offset < MAX_PENDING_OUTPUT_SIZE
+           && std::memchr(connection.input.data() + connection.input_offset, '\n', size) != nullptr;
+}
+
+void QueryServer::UpdateEvents(Connection& connection, uint32_t events) {
+    if (connection.events == events) {
+        return;
+    }
+    connection.events = events;
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = connection.socket;
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.socket, &event);
+}
+
+void QueryServer::CloseAll() {
+    for (const auto& [socket, connection] : connections_) {
+        close(socket);
+    }
+    connections_.clear();
+    for (int* descriptor : {&listener_, &epoll_, &wake_up_, &reserve_}) {
+        if (*descriptor >= 0) {
+            close(*descriptor);
+            *descriptor = -1;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Requests of one connection taken into one round of the event loop
+const size_t MAX_PIPELINED_REQUESTS = 64;
+// A connection isn't read while this many bytes of its responses wait to be sent
+const size_t MAX_PENDING_OUTPUT_SIZE = 1024 * 1024;
+const size_t MAX_REQUEST_SIZE = 64 * 1024;
+const size_t READ_CHUNK_SIZE = 16 * 1024;
+
+// Non-blocking TCP front-end of a SearchServer on epoll. Requests and responses are lines of tab-separated fields:
+//     FIND <query>                                      OK, then a field "<id> <relevance> <rating>" per document
+//     MATCH <id> <query>                                OK <status> <matched words separated by spaces>
+//     ADD <id> <status> <ratings separated by spaces> <text>   OK
+//     REMOVE <id>                                       OK
+// and a request that fails gets ERROR <message>. Responses of a connection come in the order of its requests.
+// Queries of one round of the event loop run on the thread pool of the server, changes run alone between them.
+class QueryServer {
+public:
+    // Port 0 picks a free one. Throws std::runtime_error if it can't listen.
+    QueryServer(SearchServer& search_server, const std::string& address, uint16_t port);
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    uint16_t GetPort() const;
+    void Run();
+    // May be called from any thread and from a signal handler
+    void Stop();
+
+private:
+    struct Connection {
+        int socket = -1;
+        std::vector<char> input;
+        size_t input_offset = 0;
+        std::vector<char> output;
+        size_t output_offset = 0;
+        uint32_t events = 0;
+        // Closed once its output is sent
+        bool is_closing = false;
+    };
+
+    enum class RequestType {
+        FIND,
+        MATCH,
+        ADD,
+        REMOVE,
+    };
+
+    // Fields point into the input buffer of the connection
+    struct Request {
+        Connection* connection;
+        RequestType type;
+        std::string_view fields;
+        std::vector<Document> documents;
+        std::tuple<std::vector<std::string_view>, DocumentStatus> match;
+        std::vector<int> ratings;
+        std::string error;
+    };
+
+    SearchServer& search_server_;
+    int listener_ = -1;
+    int epoll_ = -1;
+    int wake_up_ = -1;
+    // Closed to accept and drop a connection when the process runs out of descriptors
+    int reserve_ = -1;
+    bool is_listening_ = true;
+    uint16_t port_ = 0;
+    std::atomic<bool> is_stopped_ = false;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    // Reused from round to round, the first request_count_ are of the current round
+    std::vector<Request> requests_;
+    size_t request_count_ = 0;
+
+    void Accept();
+    void SetListening(bool is_listening);
+    void Read(Connection& connection);
+    void Write(Connection& connection);
+    void TakeRequests(Connection& connection);
+    void ExecuteRequests();
+    void ExecuteRequest(Request& request);
+    void WriteResponse(const Request& request);
+    // Returns false if the connection was closed
+    bool FinishRound(Connection& connection);
+    static bool HasRequests(const Connection& connection);
+    void UpdateEvents(Connection& connection, uint32_t events);
+    void CloseAll();
+};
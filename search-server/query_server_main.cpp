@@ -0,0 +1,46 @@
+#include "corpus_loader.h"
+#include "query_server.h"
+#include "search_server.h"
+
+#include <csignal>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+QueryServer* running_server = nullptr;
+
+void StopServer(int) {
+    if (running_server != nullptr) {
+        running_server->Stop();
+    }
+}
+
+} // namespace
+
+// Usage: query_server [port] [corpus file] [address]
+// Serves the documents of the corpus, in the format of LoadCorpus, until SIGINT or SIGTERM
+int main(int argc, char* argv[]) {
+    try {
+        const uint16_t port = argc > 1 ? static_cast<uint16_t>(stoi(argv[1])) : 8080;
+        const string address = argc > 3 ? argv[3] : "127.0.0.1"s;
+        SearchServer search_server("и в на"s);
+        if (argc > 2) {
+            cerr << "Loaded "s << LoadCorpus(search_server, argv[2]) << " documents"s << endl;
+        }
+        QueryServer query_server(search_server, address, port);
+        running_server = &query_server;
+        signal(SIGINT, StopServer);
+        signal(SIGTERM, StopServer);
+        cerr << "Listening on "s << address << ":"s << query_server.GetPort() << endl;
+        query_server.Run();
+        running_server = nullptr;
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
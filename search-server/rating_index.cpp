@@ -0,0 +1,54 @@
+#include "rating_index.h"
+
+#include <algorithm>
+
+RatingIndex::RatingIndex(std::pmr::memory_resource* resource)
+: buckets_(resource)
+{
+}
+
+void RatingIndex::Add(int internal_id, int rating) {
+    std::pmr::vector<int>& bucket = buckets_.try_emplace(rating).first->second;
+    // New documents come last, only a document re-rated back to an old rating lands in the middle
+    if (bucket.empty() || bucket.back() < internal_id) {
+        bucket.push_back(internal_id);
+    } else {
+        const auto it = std::lower_bound(bucket.begin(), bucket.end(), internal_id);
+        if (it != bucket.end() && *it == internal_id) {
+            // The document came back to a rating it left, its stale entry is valid again
+            stale_count_ -= std::min<size_t>(stale_count_, 1);
+            return;
+        }
+        bucket.insert(it, internal_id);
+    }
+    ++entry_count_;
+}
+
+void RatingIndex::MarkStale() {
+    ++stale_count_;
+}
+
+void RatingIndex::Clear() {
+    buckets_.clear();
+    entry_count_ = 0;
+    stale_count_ = 0;
+}
+
+size_t RatingIndex::CountInRange(int min_rating, int max_rating) const {
+    size_t count = 0;
+    if (min_rating > max_rating) {
+        return count;
+    }
+    for (auto it = buckets_.lower_bound(min_rating); it != buckets_.end() && it->first <= max_rating; ++it) {
+        count += it->second.size();
+    }
+    return count;
+}
+
+size_t RatingIndex::GetEntryCount() const {
+    return entry_count_;
+}
+
+size_t RatingIndex::GetStaleCount() const {
+    return stale_count_;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+// Internal ids by average rating. Entries of removed and re-rated documents go stale rather than being erased,
+// readers check them against the documents.
+class RatingIndex {
+public:
+    explicit RatingIndex(std::pmr::memory_resource* resource);
+
+    void Add(int internal_id, int rating);
+    void MarkStale();
+    void Clear();
+
+    // Stale entries included
+    size_t CountInRange(int min_rating, int max_rating) const;
+    template <typename Function>
+    void ForEachInRange(int min_rating, int max_rating, Function function) const;
+
+    size_t GetEntryCount() const;
+    size_t GetStaleCount() const;
+
+private:
+    std::pmr::map<int, std::pmr::vector<int>> buckets_;
+    size_t entry_count_ = 0;
+    size_t stale_count_ = 0;
+};
+
+template <typename Function>
+void RatingIndex::ForEachInRange(int min_rating, int max_rating, Function function) const {
+    if (min_rating > max_rating) {
+        return;
+    }
+    for (auto it = buckets_.lower_bound(min_rating); it != buckets_.end() && it->first <= max_rating; ++it) {
+        for (const int internal_id : it->second) {
+            function(internal_id);
+        }
+    }
+}
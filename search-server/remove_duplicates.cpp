@@ -1,12 +1,15 @@
 #include "remove_duplicates.h"
 
 void RemoveDuplicates(SearchServer& search_server) {
-    std::map<std::set<std::string_view>, std::set<int>> document_duplicator;
+    // Words come in term id order, so equal word sets give equal vectors
+    std::map<std::vector<std::string_view>, std::set<int>> document_duplicator;
     std::set<int> id_duplicates;
     for (const int id : search_server) {
-        std::set<std::string_view> words;
-        for (const auto& [word, _] : search_server.GetWordFrequencies(id)) {
-            words.insert(word);
+        std::vector<std::string_view> words;
+        const WordFrequencies word_frequencies = search_server.GetWordFrequencies(id);
+        words.reserve(word_frequencies.size());
+        for (const auto& [word, _] : word_frequencies) {
+            words.push_back(word);
         }
 
         if (document_duplicator.count(words) != 0) {
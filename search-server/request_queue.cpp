@@ -9,12 +9,14 @@ RequestQueue::RequestQueue(const SearchServer& search_server)
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
+    RecordQuery(raw_query, status);
     std::vector<Document> top_documents = search_server_.FindTopDocuments(raw_query, status);
     UpdateDeque(top_documents);
     return top_documents;
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
+    RecordQuery(raw_query, DocumentStatus::ACTUAL);
     std::vector<Document> top_documents = search_server_.FindTopDocuments(raw_query);
     UpdateDeque(top_documents);
     return top_documents;
@@ -26,6 +28,16 @@ int RequestQueue::GetNoResultRequests() const {
     });
 }
 
+void RequestQueue::SetQueryLog(std::ostream* query_log) {
+    query_log_ = query_log;
+}
+
+void RequestQueue::RecordQuery(const std::string& raw_query, DocumentStatus status) {
+    if (query_log_ != nullptr) {
+        *query_log_ << GetDocumentStatusName(status) << '\t' << raw_query << '\n';
+    }
+}
+
 void RequestQueue::UpdateDeque(const std::vector<Document>& top_document) {
     QueryResult query_result(top_document);
     ++count_query;
@@ -2,6 +2,7 @@
 
 #include "search_server.h"
 #include "document.h"
+#include <ostream>
 #include <string>
 #include <vector>
 #include <deque>
@@ -17,6 +18,9 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
     int GetNoResultRequests() const;
+    // Records every request as a line "<status> TAB <query>" that ReadQueryLog reads back, nullptr stops recording.
+    // A predicate can't be replayed, so requests with one are recorded as ACTUAL.
+    void SetQueryLog(std::ostream* query_log);
 
 private:
     struct QueryResult {
@@ -33,12 +37,15 @@ private:
     const static int min_in_day_ = 1440;
     const SearchServer& search_server_;
     int count_query;
+    std::ostream* query_log_ = nullptr;
 
+    void RecordQuery(const std::string& raw_query, DocumentStatus status);
     void UpdateDeque(const std::vector<Document>& top_document);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    RecordQuery(raw_query, DocumentStatus::ACTUAL);
     std::vector<Document> top_documents = search_server_.FindTopDocuments(raw_query, document_predicate);
     UpdateDeque(top_documents);
     return top_documents;
@@ -0,0 +1,162 @@
+#include "score_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCORE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool IsExcluded(const uint32_t* exclusion_mask, int offset) {
+    return (exclusion_mask[offset >> 5] >> (offset & 31)) & 1;
+}
+
+void AccumulateScoresScalar(const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                            int base, const uint32_t* exclusion_mask, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        const int offset = internal_ids[i] - base;
+        if (!IsExcluded(exclusion_mask, offset)) {
+            scores[offset] += weight * term_freqs[i];
+        }
+    }
+}
+
+#ifdef SCORE_KERNELS_X86
+
+// Exclusion bits of four documents, all ones in the 64-bit lanes of the excluded ones
+__attribute__((target("avx2")))
+__m256i GatherExcluded(const uint32_t* exclusion_mask, __m128i offsets) {
+    const __m128i words = _mm_i32gather_epi32(reinterpret_cast<const int*>(exclusion_mask), _mm_srli_epi32(offsets, 5), 4);
+    const __m128i bits = _mm_and_si128(_mm_srlv_epi32(words, _mm_and_si128(offsets, _mm_set1_epi32(31))), _mm_set1_epi32(1));
+    return _mm256_cvtepi32_epi64(_mm_sub_epi32(_mm_setzero_si128(), bits));
+}
+
+__attribute__((target("avx2")))
+void AccumulateScoresAvx2(const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                          int base, const uint32_t* exclusion_mask, double* scores) {
+    const __m256d weights = _mm256_set1_pd(weight);
+    const __m128i bases = _mm_set1_epi32(base);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i offsets = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(internal_ids + i)), bases);
+        const __m256d products = _mm256_andnot_pd(_mm256_castsi256_pd(GatherExcluded(exclusion_mask, offsets)),
+                                                  _mm256_mul_pd(_mm256_loadu_pd(term_freqs + i), weights));
+        const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d sums = _mm256_add_pd(_mm256_mask_i32gather_pd(_mm256_setzero_pd(), scores, offsets, all_lanes, 8), products);
+
+        // AVX2 has no scatter, the sums go back one by one
+        alignas(32) double values[4];
+        alignas(16) int lanes[4];
+        _mm256_store_pd(values, sums);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), offsets);
+        for (int lane = 0; lane < 4; ++lane) {
+            scores[lanes[lane]] = values[lane];
+        }
+    }
+    AccumulateScoresScalar(internal_ids + i, term_freqs + i, count - i, weight, base, exclusion_mask, scores);
+}
+
+__attribute__((target("avx512f")))
+void AccumulateScoresAvx512(const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                            int base, const uint32_t* exclusion_mask, double* scores) {
+    const __m512d weights = _mm512_set1_pd(weight);
+    const __m256i bases = _mm256_set1_epi32(base);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i offsets = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(internal_ids + i)), bases);
+        const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(exclusion_mask), _mm256_srli_epi32(offsets, 5), 4);
+        const __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(offsets, _mm256_set1_epi32(31))),
+                                              _mm256_set1_epi32(1));
+        const __m256i is_kept_lanes = _mm256_cmpeq_epi32(bits, _mm256_setzero_si256());
+        const __mmask8 is_kept = static_cast<__mmask8>(_mm256_movemask_ps(_mm256_castsi256_ps(is_kept_lanes)));
+
+        const __m512d scores_before = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), is_kept, offsets, scores, 8);
+        const __m512d sums = _mm512_fmadd_pd(_mm512_loadu_pd(term_freqs + i), weights, scores_before);
+        _mm512_mask_i32scatter_pd(scores, is_kept, offsets, sums, 8);
+    }
+    AccumulateScoresScalar(internal_ids + i, term_freqs + i, count - i, weight, base, exclusion_mask, scores);
+}
+
+#endif
+
+ScoreKernel DetectScoreKernel() {
+    if (IsScoreKernelSupported(ScoreKernel::AVX512)) {
+        return ScoreKernel::AVX512;
+    }
+    if (IsScoreKernelSupported(ScoreKernel::AVX2)) {
+        return ScoreKernel::AVX2;
+    }
+    return ScoreKernel::SCALAR;
+}
+
+std::atomic<ScoreKernel>& GetKernelChoice() {
+    static std::atomic<ScoreKernel> kernel = DetectScoreKernel();
+    return kernel;
+}
+
+} // namespace
+
+bool IsScoreKernelSupported(ScoreKernel kernel) {
+    switch (kernel) {
+#ifdef SCORE_KERNELS_X86
+        case ScoreKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case ScoreKernel::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+#endif
+        case ScoreKernel::SCALAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+ScoreKernel GetScoreKernel() {
+    return GetKernelChoice().load(std::memory_order_relaxed);
+}
+
+void SetScoreKernel(ScoreKernel kernel) {
+    GetKernelChoice().store(kernel, std::memory_order_relaxed);
+}
+
+void AccumulateScores(const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                      int base, const uint32_t* exclusion_mask, double* scores) {
+    AccumulateScores(GetScoreKernel(), internal_ids, term_freqs, count, weight, base, exclusion_mask, scores);
+}
+
+void AccumulateScores(ScoreKernel kernel, const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                      int base, const uint32_t* exclusion_mask, double* scores) {
+    switch (kernel) {
+#ifdef SCORE_KERNELS_X86
+        case ScoreKernel::AVX2:
+            AccumulateScoresAvx2(internal_ids, term_freqs, count, weight, base, exclusion_mask, scores);
+            return;
+        case ScoreKernel::AVX512:
+            AccumulateScoresAvx512(internal_ids, term_freqs, count, weight, base, exclusion_mask, scores);
+            return;
+#endif
+        default:
+            AccumulateScoresScalar(internal_ids, term_freqs, count, weight, base, exclusion_mask, scores);
+    }
+}
+
+void AddToExclusionMask(const int* internal_ids, size_t count, int base, size_t document_count, uint32_t* exclusion_mask) {
+    const int* first = std::lower_bound(internal_ids, internal_ids + count, base);
+    const int* last = std::lower_bound(first, internal_ids + count, base + static_cast<int>(document_count));
+    for (const int* it = first; it != last; ++it) {
+        const int offset = *it - base;
+        exclusion_mask[offset >> 5] |= uint32_t{1} << (offset & 31);
+    }
+}
+
+void RemoveFromExclusionMask(const int* internal_ids, size_t count, int base, size_t document_count, uint32_t* exclusion_mask) {
+    const int* first = std::lower_bound(internal_ids, internal_ids + count, base);
+    const int* last = std::lower_bound(first, internal_ids + count, base + static_cast<int>(document_count));
+    for (const int* it = first; it != last; ++it) {
+        const int offset = *it - base;
+        exclusion_mask[offset >> 5] &= ~(uint32_t{1} << (offset & 31));
+    }
+}
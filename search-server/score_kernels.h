@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class ScoreKernel {
+    SCALAR,
+    AVX2,
+    AVX512,
+};
+
+bool IsScoreKernelSupported(ScoreKernel kernel);
+// The widest kernel the CPU runs, unless another one was set
+ScoreKernel GetScoreKernel();
+// Process-wide, for benchmarks
+void SetScoreKernel(ScoreKernel kernel);
+
+// scores[internal_ids[i] - base] += weight * term_freqs[i] unless the bit of the document is set in the exclusion
+// mask. Internal ids must be distinct.
+void AccumulateScores(const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                      int base, const uint32_t* exclusion_mask, double* scores);
+void AccumulateScores(ScoreKernel kernel, const int* internal_ids, const double* term_freqs, size_t count, double weight,
+                      int base, const uint32_t* exclusion_mask, double* scores);
+
+// Ids outside [base, base + document_count) are ignored
+void AddToExclusionMask(const int* internal_ids, size_t count, int base, size_t document_count, uint32_t* exclusion_mask);
+void RemoveFromExclusionMask(const int* internal_ids, size_t count, int base, size_t document_count, uint32_t* exclusion_mask);
+
+inline size_t GetExclusionMaskSize(size_t document_count) {
+    return (document_count + 31) / 32;
+}
@@ -1,44 +1,172 @@
 #include "search_server.h"
 #include <numeric>
 #include <cmath>
+#include <thread>
 
-SearchServer::SearchServer(const std::string& stop_words_text)
-        : SearchServer(std::string_view(stop_words_text))
+SearchServer::SearchServer(const std::string& stop_words_text, std::pmr::memory_resource* index_resource)
+        : SearchServer(std::string_view(stop_words_text), index_resource)
 {
 }
 
-SearchServer::SearchServer(const std::string_view& stop_words_view)
-        : SearchServer(SplitIntoWords(stop_words_view))
+SearchServer::SearchServer(const std::string_view& stop_words_view, std::pmr::memory_resource* index_resource)
+        : SearchServer(SplitIntoWords(stop_words_view), index_resource)
 {
 }
 
+SearchServer::~SearchServer() {
+    WaitForMerges();
+}
+
 void SearchServer::AddDocument(int document_id,
                                const std::string_view& document,
                                const DocumentStatus& status,
                                const std::vector<int>& ratings) {
     if (document_id < 0 ||
-        documents_.count(document_id) > 0) {
+        internal_ids_.count(document_id) > 0) {
         throw std::invalid_argument("Invalid range when adding a document!");
     }
     if (!IsValidWord(document)) {
         throw std::invalid_argument("Invalid document!");
     }
+    EnforceMemoryBudget();
+    if (write_ahead_log_ != nullptr) {
+        write_ahead_log_->LogAddDocument(document_id, document, status, ratings);
+    }
     ids_.emplace(document_id);
 
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    const size_t first_entry = document_word_freq_.size();
+    AppendDocumentTerms(document);
+    for (auto it = document_word_freq_.begin() + first_entry; it != document_word_freq_.end(); ++it) {
+        ++document_freqs_[it->term_id];
+    }
+
+    const int internal_id = static_cast<int>(document_word_offsets_.size()) - 1;
+    document_word_offsets_.push_back(document_word_freq_.size());
+    internal_ids_.emplace(document_id, internal_id);
+    {
+        std::lock_guard guard(segments_guard_);
+        documents_.push_back({document_id, ComputeAverageRating(ratings), status, false});
+    }
+    rating_index_.Add(internal_id, documents_.back().rating);
+
+    mutable_segment_.AddDocument(internal_id, GetDocumentTermsBegin(internal_id), GetDocumentTermsEnd(internal_id));
+    AddToChampionLists(internal_id);
+    if (mutable_segment_.GetDocumentCount() >= MUTABLE_SEGMENT_DOCUMENT_COUNT) {
+        FlushSegment();
+    }
+}
+
+void SearchServer::UpdateDocumentAttributes(int document_id, const DocumentStatus& status, const std::vector<int>& ratings) {
+    const int internal_id = internal_ids_.at(document_id);
+    if (write_ahead_log_ != nullptr) {
+        write_ahead_log_->LogUpdateDocumentAttributes(document_id, status, ratings);
+    }
+    // Postings and champion lists don't depend on the attributes, queries read them from here
+    const int rating = ComputeAverageRating(ratings);
+    int old_rating = 0;
+    {
+        std::lock_guard guard(segments_guard_);
+        DocumentData& document_data = documents_[internal_id];
+        old_rating = document_data.rating;
+        document_data.status = status;
+        document_data.rating = rating;
+    }
+    if (rating != old_rating) {
+        rating_index_.Add(internal_id, rating);
+        MarkRatingStale();
+    }
+}
+
+void SearchServer::UpdateDocument(int document_id, const std::string_view& document) {
+    if (internal_ids_.count(document_id) == 0) {
+        throw std::out_of_range("No document with this id!");
+    }
+    if (!IsValidWord(document)) {
+        throw std::invalid_argument("Invalid document!");
+    }
+    EnforceMemoryBudget();
+    // Looked up after the budget check, whose compaction renumbers the documents
+    const int old_internal_id = internal_ids_.at(document_id);
+    const size_t first_entry = document_word_freq_.size();
+    AppendDocumentTerms(document);
+    const TermFrequency* const old_first = GetDocumentTermsBegin(old_internal_id);
+    const TermFrequency* const old_last = GetDocumentTermsEnd(old_internal_id);
+    const TermFrequency* const new_first = document_word_freq_.data() + first_entry;
+    const TermFrequency* const new_last = document_word_freq_.data() + document_word_freq_.size();
+    if (std::equal(old_first, old_last, new_first, new_last, [](const TermFrequency& lhs, const TermFrequency& rhs) {
+            return lhs.term_id == rhs.term_id && lhs.term_freq == rhs.term_freq;
+        })) {
+        document_word_freq_.resize(first_entry);
+        return;
+    }
+    // No-op updates aren't logged
+    if (write_ahead_log_ != nullptr) {
+        write_ahead_log_->LogUpdateDocument(document_id, document);
+    }
+
+    // Only terms that came or went change their document frequency
+    for (const TermFrequency *old_it = old_first, *new_it = new_first; old_it != old_last || new_it != new_last;) {
+        if (new_it == new_last || (old_it != old_last && old_it->term_id < new_it->term_id)) {
+            --document_freqs_[(old_it++)->term_id];
+        } else if (old_it == old_last || new_it->term_id < old_it->term_id) {
+            ++document_freqs_[(new_it++)->term_id];
+        } else {
+            ++old_it;
+            ++new_it;
+        }
+    }
+
+    // Sealed postings never change, so the new text takes a new internal id
+    {
+        std::lock_guard guard(segments_guard_);
+        documents_[old_internal_id].is_removed = true;
+    }
+    RemoveFromChampionLists(old_internal_id);
+    ++removed_since_compaction_;
+    const int internal_id = static_cast<int>(document_word_offsets_.size()) - 1;
+    document_word_offsets_.push_back(document_word_freq_.size());
+    internal_ids_[document_id] = internal_id;
+    {
+        std::lock_guard guard(segments_guard_);
+        DocumentData document_data = documents_[old_internal_id];
+        document_data.is_removed = false;
+        documents_.push_back(document_data);
+    }
+    rating_index_.Add(internal_id, documents_.back().rating);
+    MarkRatingStale();
+    mutable_segment_.AddDocument(internal_id, GetDocumentTermsBegin(internal_id), GetDocumentTermsEnd(internal_id));
+    AddToChampionLists(internal_id);
+    if (mutable_segment_.GetDocumentCount() >= MUTABLE_SEGMENT_DOCUMENT_COUNT) {
+        FlushSegment();
+    }
+}
+
+void SearchServer::AppendDocumentTerms(const std::string_view& document) {
+    QueryArena arena;
+    std::pmr::vector<char> normalized_document(&arena);
+    const std::pmr::vector<std::string_view> words = SplitIntoWordsNoStop(document, normalized_document);
     const double inv_word_count = 1.0 / words.size();
-    std::map<std::string_view, double> word_freq;
+    const size_t first_entry = document_word_freq_.size();
 
-    for (const std::string_view& word : std::move(words)) {
-        const std::string& word_as_str = static_cast<std::string>(std::move(word));
-        words_documents_.insert(word_as_str);
-        auto it = words_documents_.find(word_as_str);
-        word_to_document_freqs_[*it][document_id] += inv_word_count;
-        word_freq[*it] += inv_word_count;
+    for (const std::string_view& word : words) {
+        document_word_freq_.push_back({term_dictionary_.Insert(word), inv_word_count});
     }
 
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
-    document_word_freq_.emplace(document_id, std::move(word_freq));
+    // Repeated words are folded into one entry per term
+    const auto first = document_word_freq_.begin() + first_entry;
+    std::sort(first, document_word_freq_.end(), [](const TermFrequency& lhs, const TermFrequency& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+    auto last = first;
+    for (auto it = first; it != document_word_freq_.end(); ++it) {
+        if (last != first && std::prev(last)->term_id == it->term_id) {
+            std::prev(last)->term_freq += it->term_freq;
+        } else {
+            *last++ = *it;
+        }
+    }
+    document_word_freq_.erase(last, document_word_freq_.end());
+    document_freqs_.resize(term_dictionary_.GetTermCount(), 0);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, const DocumentStatus& status) const {
@@ -48,57 +176,316 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw
                             });
 }
 
+void SearchServer::FindTopDocuments(std::execution::sequenced_policy policy,
+                                    const std::string_view& raw_query,
+                                    std::vector<Document>& documents) const {
+    FindSelectedDocuments(policy, raw_query,
+                          [](int document_id, const DocumentStatus& document_status, int rating) {
+                              return document_status == DocumentStatus::ACTUAL;
+                          },
+                          TopSelection{}, nullptr, documents);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter) const {
+    return FindTopDocuments(std::execution::seq, raw_query, filter);
+}
+
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(const std::string_view& raw_query,
+                                                                       const DocumentStatus& status,
+                                                                       TaskPriority priority) const {
+    return FindTopDocumentsAsync(raw_query,
+                                 [status](int document_id, const DocumentStatus& document_status, int rating) {
+                                     return document_status == status;
+                                 },
+                                 priority);
+}
+
+void SearchServer::SetExecutionThresholds(const ExecutionThresholds& thresholds) {
+    execution_thresholds_ = thresholds;
+    are_execution_thresholds_set_ = true;
+}
+
+void SearchServer::SetThreadPool(ThreadPool& thread_pool) {
+    thread_pool_ = &thread_pool;
+}
+
+ThreadPool& SearchServer::GetThreadPool() const {
+    return *thread_pool_;
+}
+
+void SearchServer::SetWriteAheadLog(WriteAheadLog* write_ahead_log) {
+    write_ahead_log_ = write_ahead_log;
+}
+
+void SearchServer::SetImpactPrecision(ImpactPrecision precision) {
+    impact_precision_ = precision;
+    RefreshImpacts();
+}
+
+void SearchServer::FlushSegment() {
+    if (mutable_segment_.GetDocumentCount() == 0) {
+        return;
+    }
+    {
+        std::lock_guard guard(segments_guard_);
+        const int first_internal_id = mutable_segment_.GetFirstInternalId();
+        const int last_internal_id = mutable_segment_.GetLastInternalId();
+        segments_.push_back(IndexSegment::Seal(mutable_segment_, GetRemovedFlags(first_internal_id, last_internal_id),
+                                               &sealed_segments_resource_));
+        mutable_segment_ = MutableSegment(last_internal_id, &mutable_segment_resource_);
+        ScheduleMerge();
+    }
+    RefreshImpacts();
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    stats.words = words_resource_.GetBytesInUse();
+    stats.forward_index = forward_index_resource_.GetBytesInUse();
+    stats.documents = documents_resource_.GetBytesInUse();
+    stats.ids = ids_resource_.GetBytesInUse();
+    stats.champion_lists = champion_lists_resource_.GetBytesInUse();
+    stats.rating_index = rating_index_resource_.GetBytesInUse();
+    stats.mutable_segment = mutable_segment_resource_.GetBytesInUse();
+    stats.sealed_segments = sealed_segments_resource_.GetBytesInUse();
+    return stats;
+}
+
+void SearchServer::SetMemoryBudget(const MemoryBudget& budget) {
+    memory_budget_ = budget;
+}
+
+void SearchServer::EnforceMemoryBudget() {
+    auto is_over_budget = [this] {
+        return memory_budget_.limit > 0 && GetMemoryStats().GetTotal() >= memory_budget_.limit;
+    };
+    if (!is_over_budget()) {
+        return;
+    }
+    // Removed and replaced documents are what a compaction gives back, without them it would only cost a rebuild.
+    // Unlike Compact, renumbering drops them from the forward index, the documents and the rating index too.
+    if (removed_since_compaction_ > 0) {
+        std::vector<int> order;
+        for (int internal_id = 0; internal_id < static_cast<int>(documents_.size()); ++internal_id) {
+            if (!documents_[internal_id].is_removed) {
+                order.push_back(internal_id);
+            }
+        }
+        RenumberDocuments(order);
+        if (!is_over_budget()) {
+            return;
+        }
+    }
+    if (memory_budget_.policy == MemoryBudgetPolicy::THROTTLE) {
+        // A merge in flight holds its inputs and its output at once
+        WaitForMerges();
+        if (!is_over_budget()) {
+            return;
+        }
+        std::this_thread::sleep_for(memory_budget_.throttle_delay);
+    }
+    throw MemoryBudgetExceeded(GetMemoryStats().GetTotal(), memory_budget_.limit);
+}
+
+void SearchServer::WaitForMerges() {
+    std::future<void> merge;
+    {
+        std::lock_guard guard(segments_guard_);
+        merge = std::move(merge_);
+    }
+    if (merge.valid()) {
+        merge.wait();
+    }
+}
+
+void SearchServer::Compact() {
+    FlushSegment();
+    WaitForMerges();
+    {
+        std::lock_guard guard(segments_guard_);
+        if (segments_.empty()) {
+            return;
+        }
+        const std::vector<char> is_removed = GetRemovedFlags(segments_.front()->GetFirstInternalId(), segments_.back()->GetLastInternalId());
+        std::shared_ptr<const IndexSegment> merged = IndexSegment::Merge(segments_, is_removed, &sealed_segments_resource_);
+        segments_.assign(1, std::move(merged));
+        removed_since_compaction_ = 0;
+    }
+    RefreshImpacts();
+}
+
+namespace {
+
+const size_t MINHASH_SIGNATURE_SIZE = 4;
+
+// Splitmix64
+uint64_t HashTerm(int term_id, size_t seed) {
+    uint64_t hash = static_cast<uint64_t>(term_id) + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+} // namespace
+
+void SearchServer::ReorderDocuments() {
+    // Documents agree in a minimum with the probability of the Jaccard similarity of their terms
+    const size_t signature_size = MINHASH_SIGNATURE_SIZE;
+    std::vector<int> order;
+    std::vector<uint64_t> signatures;
+    for (int internal_id = 0; internal_id < static_cast<int>(documents_.size()); ++internal_id) {
+        if (documents_[internal_id].is_removed) {
+            continue;
+        }
+        order.push_back(internal_id);
+        for (size_t seed = 0; seed < signature_size; ++seed) {
+            uint64_t minimum = std::numeric_limits<uint64_t>::max();
+            for (const TermFrequency* entry = GetDocumentTermsBegin(internal_id); entry != GetDocumentTermsEnd(internal_id); ++entry) {
+                minimum = std::min(minimum, HashTerm(entry->term_id, seed));
+            }
+            signatures.push_back(minimum);
+        }
+    }
+    std::vector<size_t> ranks(order.size());
+    std::iota(ranks.begin(), ranks.end(), 0);
+    std::stable_sort(ranks.begin(), ranks.end(), [&](size_t lhs, size_t rhs) {
+        return std::lexicographical_compare(signatures.begin() + lhs * signature_size, signatures.begin() + (lhs + 1) * signature_size,
+                                            signatures.begin() + rhs * signature_size, signatures.begin() + (rhs + 1) * signature_size);
+    });
+    std::vector<int> new_order;
+    new_order.reserve(ranks.size());
+    for (const size_t rank : ranks) {
+        new_order.push_back(order[rank]);
+    }
+    RenumberDocuments(new_order);
+}
+
+void SearchServer::RenumberDocuments(const std::vector<int>& order) {
+    FlushSegment();
+    WaitForMerges();
+
+    // The forward index and the postings are rebuilt in the new order, removed documents are dropped
+    size_t entry_count = 0;
+    for (const int old_internal_id : order) {
+        entry_count += GetDocumentTermsEnd(old_internal_id) - GetDocumentTermsBegin(old_internal_id);
+    }
+    std::pmr::vector<DocumentData> documents(&documents_resource_);
+    std::pmr::vector<TermFrequency> document_word_freq(&forward_index_resource_);
+    std::pmr::vector<size_t> document_word_offsets(1, 0, &forward_index_resource_);
+    documents.reserve(order.size());
+    document_word_freq.reserve(entry_count);
+    document_word_offsets.reserve(order.size() + 1);
+    MutableSegment segment(0, &mutable_segment_resource_);
+    for (size_t internal_id = 0; internal_id < order.size(); ++internal_id) {
+        const int old_internal_id = order[internal_id];
+        documents.push_back(documents_[old_internal_id]);
+        internal_ids_[documents.back().id] = static_cast<int>(internal_id);
+        document_word_freq.insert(document_word_freq.end(), GetDocumentTermsBegin(old_internal_id), GetDocumentTermsEnd(old_internal_id));
+        document_word_offsets.push_back(document_word_freq.size());
+        segment.AddDocument(static_cast<int>(internal_id), document_word_freq.data() + document_word_offsets[internal_id],
+                            document_word_freq.data() + document_word_offsets[internal_id + 1]);
+    }
+
+    {
+        std::lock_guard guard(segments_guard_);
+        // The segment stays in the tier a compaction would give it
+        size_t tier = 0;
+        for (const auto& sealed : segments_) {
+            tier = std::max(tier, sealed->GetTier() + (segments_.size() > 1 ? 1 : 0));
+        }
+        segments_.clear();
+        if (!order.empty()) {
+            segments_.push_back(IndexSegment::Seal(segment, std::vector<char>(order.size(), 0), &sealed_segments_resource_, tier));
+        }
+        documents_ = std::move(documents);
+    }
+    document_word_freq_ = std::move(document_word_freq);
+    document_word_offsets_ = std::move(document_word_offsets);
+    mutable_segment_ = MutableSegment(static_cast<int>(order.size()), &mutable_segment_resource_);
+    removed_since_compaction_ = 0;
+    for (auto& [term_id, list] : champion_lists_) {
+        RebuildChampionList(term_id, list);
+    }
+    RebuildRatingIndex();
+    RefreshImpacts();
+}
+
+size_t SearchServer::GetDeltaEncodedPostingBits() const {
+    std::lock_guard guard(segments_guard_);
+    size_t bits = 0;
+    for (const auto& segment : segments_) {
+        bits += segment->GetDeltaEncodedBits();
+    }
+    return bits;
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    std::lock_guard guard(segments_guard_);
+    return segments_.size();
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return internal_ids_.size();
 }
 
-std::set<int>::const_iterator SearchServer::begin() const {
+std::pmr::set<int>::const_iterator SearchServer::begin() const {
     return ids_.begin();
 }
 
-std::set<int>::const_iterator SearchServer::end() const {
+std::pmr::set<int>::const_iterator SearchServer::end() const {
     return ids_.end();
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view& raw_query,
                                                                                       int document_id) const {
-    Query query = ParseQuery(raw_query);
-    auto& minus = query.minus_words;
-    auto& plus = query.plus_words;
+    QueryArena arena;
+    const Query query = ParseQuery(raw_query, &arena);
+    return MatchQueryTerms(query, GetQueryTerms(query, &arena), document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(const std::string_view& raw_query,
+                                                                                                    const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
 
-    if (std::any_of(minus.begin(), minus.end(), [&](const std::string_view& word) {
-        return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id) != 0;
-    })
-            ) {
-        return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::execution::sequenced_policy policy,
+                                                                                                    const std::string_view& raw_query,
+                                                                                                    const std::vector<int>& document_ids) const {
+    QueryArena arena;
+    const Query query = ParseQuery(raw_query, &arena);
+    const QueryTerms terms = GetQueryTerms(query, &arena);
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> matches;
+    matches.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        matches.push_back(MatchQueryTerms(query, terms, document_id));
     }
+    return matches;
+}
 
-    std::vector<std::string_view> matched_words(plus.size());
-    auto last = std::copy_if(plus.begin(), plus.end(), matched_words.begin(), [&](const std::string_view& word) {
-        return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id) != 0;
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::execution::parallel_policy policy,
+                                                                                                    const std::string_view& raw_query,
+                                                                                                    const std::vector<int>& document_ids) const {
+    QueryArena arena;
+    const Query query = ParseQuery(raw_query, &arena);
+    const QueryTerms terms = GetQueryTerms(query, &arena);
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> matches(document_ids.size());
+    thread_pool_->ParallelFor(document_ids.size(), [&](size_t index) {
+        matches[index] = MatchQueryTerms(query, terms, document_ids[index]);
     });
-    matched_words.erase(last, matched_words.end());
-
-    return {std::move(matched_words), documents_.at(document_id).status};
+    return matches;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const std::map<std::string_view, double> dummy;
-    return document_word_freq_.count(document_id) == 0 ? dummy : document_word_freq_.at(document_id);
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = internal_ids_.find(document_id);
+    if (it == internal_ids_.end()) {
+        return {};
+    }
+    const int internal_id = it->second;
+    return {GetDocumentTermsBegin(internal_id), GetDocumentTermsEnd(internal_id), term_dictionary_.GetTerms()};
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (documents_.count(document_id) == 0) {
-        return;
-    }
-
-    for (const auto& [word, _] : document_word_freq_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
-    }
-
-    documents_.erase(document_id);
-    document_word_freq_.erase(document_id);
-    ids_.erase(document_id);
+    RemoveDocument(std::execution::seq, document_id);
 }
 
 bool SearchServer::IsValidWord(const std::string_view& word) {
@@ -112,10 +499,14 @@ bool SearchServer::IsStopWord(const std::string_view& word) const {
     return stop_words_.count(word) > 0;
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
-    auto v = SplitIntoWordsView(text);
+std::pmr::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text,
+                                                                     std::pmr::vector<char>& normalized_text) const {
+    std::pmr::memory_resource* resource = normalized_text.get_allocator().resource();
+    normalized_text.assign(text.begin(), text.end());
+    NormalizeText(normalized_text.data(), normalized_text.size());
+    auto v = SplitIntoWordsView(std::string_view(normalized_text.data(), normalized_text.size()), resource);
 
-    std::vector<std::string_view> words;
+    std::pmr::vector<std::string_view> words(resource);
     words.reserve(v.size());
     for (const std::string_view& word : std::move(v)) {
         if (!IsStopWord(word)) {
@@ -132,77 +523,334 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
+int SearchServer::GetTermId(const std::string_view& word) const {
+    return term_dictionary_.Find(word);
+}
+
+const TermFrequency* SearchServer::GetDocumentTermsBegin(int internal_id) const {
+    return document_word_freq_.data() + document_word_offsets_[internal_id];
+}
+
+const TermFrequency* SearchServer::GetDocumentTermsEnd(int internal_id) const {
+    return document_word_freq_.data() + document_word_offsets_[internal_id + 1];
+}
+
+std::vector<Document> SearchServer::FindTopDocumentsAfter(const std::string_view& raw_query,
+                                                          const std::optional<Document>& cursor,
+                                                          size_t page_size,
+                                                          const DocumentStatus& status) const {
+    return FindTopDocumentsAfter(std::execution::seq, raw_query, cursor, page_size, status);
+}
+
+SearchServer::TopDocuments::TopDocuments(const TopSelection& selection, std::pmr::memory_resource* resource)
+: selection_(selection)
+, heap_(resource)
+{
+    heap_.reserve(selection_.count);
+}
+
+void SearchServer::TopDocuments::Add(const Document& document) {
+    if (selection_.cursor != nullptr && !IsMoreRelevant(*selection_.cursor, document)) {
+        return;
+    }
+    // The worst document is on top of the heap, the new one replaces it if it's better
+    if (heap_.size() < selection_.count) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (!heap_.empty() && IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+size_t SearchServer::TopDocuments::Extract(Document* output) {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    std::copy(heap_.begin(), heap_.end(), output);
+    const size_t count = heap_.size();
+    heap_.clear();
+    return count;
+}
+
+namespace {
+
+template <typename Entry>
+bool IsBetterChampion(const Entry& lhs, const Entry& rhs) {
+    return lhs.term_freq > rhs.term_freq || (lhs.term_freq == rhs.term_freq && lhs.internal_id < rhs.internal_id);
+}
+
+} // namespace
+
+void SearchServer::ChampionList::Offer(const Entry& entry) {
+    if (entries.size() == CHAMPION_LIST_SIZE && !IsBetterChampion(entry, entries.back())) {
+        boundary_term_freq = std::max(boundary_term_freq, entry.term_freq);
+        return;
+    }
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, IsBetterChampion<Entry>), entry);
+    if (entries.size() > CHAMPION_LIST_SIZE) {
+        boundary_term_freq = std::max(boundary_term_freq, entries.back().term_freq);
+        entries.pop_back();
+    }
+}
+
+bool SearchServer::ChampionList::Remove(int internal_id) {
+    const auto it = std::find_if(entries.begin(), entries.end(), [internal_id](const Entry& entry) {
+        return entry.internal_id == internal_id;
+    });
+    if (it == entries.end()) {
+        return false;
+    }
+    entries.erase(it);
+    return true;
+}
+
+void SearchServer::AddToChampionLists(int internal_id) {
+    for (const TermFrequency* entry = GetDocumentTermsBegin(internal_id); entry != GetDocumentTermsEnd(internal_id); ++entry) {
+        const auto it = champion_lists_.find(entry->term_id);
+        if (it != champion_lists_.end()) {
+            it->second.Offer({entry->term_freq, internal_id});
+        } else if (document_freqs_[entry->term_id] >= CHAMPION_LIST_MIN_DOCUMENT_FREQ) {
+            RebuildChampionList(entry->term_id, champion_lists_.try_emplace(entry->term_id, &champion_lists_resource_).first->second);
+        }
+    }
+}
+
+void SearchServer::RemoveFromChampionLists(int internal_id) {
+    for (const TermFrequency* entry = GetDocumentTermsBegin(internal_id); entry != GetDocumentTermsEnd(internal_id); ++entry) {
+        const auto it = champion_lists_.find(entry->term_id);
+        if (it == champion_lists_.end() || !it->second.Remove(internal_id)) {
+            continue;
+        }
+        // The boundary stays an upper bound, but a short list proves fewer pages exact
+        ChampionList& list = it->second;
+        if (list.entries.size() < CHAMPION_LIST_SIZE / 2 && list.boundary_term_freq > 0.0) {
+            RebuildChampionList(entry->term_id, list);
+        }
+    }
+}
+
+void SearchServer::RebuildChampionList(int term_id, ChampionList& list) const {
+    using Entry = ChampionList::Entry;
+    std::vector<Entry> entries;
+    auto add_postings = [&](const PostingList& postings) {
+        for (size_t i = 0; i < postings.size; ++i) {
+            if (!documents_[postings.internal_ids[i]].is_removed) {
+                entries.push_back({postings.term_freqs[i], postings.internal_ids[i]});
+            }
+        }
+    };
+    QueryArena arena;
+    for (const auto& segment : GetSegments(&arena)) {
+        add_postings(segment->GetPostings(term_id));
+    }
+    add_postings(mutable_segment_.GetPostings(term_id));
+
+    list.boundary_term_freq = 0.0;
+    if (entries.size() > CHAMPION_LIST_SIZE) {
+        std::nth_element(entries.begin(), entries.begin() + CHAMPION_LIST_SIZE, entries.end(), IsBetterChampion<Entry>);
+        list.boundary_term_freq = entries[CHAMPION_LIST_SIZE].term_freq;
+        entries.resize(CHAMPION_LIST_SIZE);
+    }
+    std::sort(entries.begin(), entries.end(), IsBetterChampion<Entry>);
+    list.entries.assign(entries.begin(), entries.end());
+}
+
+void SearchServer::MarkRatingStale() {
+    rating_index_.MarkStale();
+    if (rating_index_.GetStaleCount() * 2 > rating_index_.GetEntryCount()) {
+        RebuildRatingIndex();
+    }
+}
+
+void SearchServer::RebuildRatingIndex() {
+    rating_index_.Clear();
+    for (int internal_id = 0; internal_id < static_cast<int>(documents_.size()); ++internal_id) {
+        if (!documents_[internal_id].is_removed) {
+            rating_index_.Add(internal_id, documents_[internal_id].rating);
+        }
+    }
+}
+
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    // Ties are broken by id, so that results don't depend on how the work was split
+    if (std::abs(lhs.relevance - rhs.relevance) >= MIN_RELEVANCE_DIFFERENCE) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
 SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
     bool is_minus = false;
+    bool is_required = false;
+    bool is_prefix = false;
+    int max_distance = -1;
     // Word shouldn't be empty
     if (text[0] == '-') {
         is_minus = true;
         text = text.substr(1);
+    } else if (text[0] == '+') {
+        is_required = true;
+        text = text.substr(1);
     }
     if (!IsValidWord(text)) {
         throw std::invalid_argument("Incorrect symbols at query!");
     }
     if (text.empty()) {
-        throw std::invalid_argument("There isn't word after \"-\"");
+        throw std::invalid_argument(is_minus ? "There isn't word after \"-\"" : "There isn't word after \"+\"");
     }
-    if (text[0] == '-') {
+    if (text[0] == '-' && is_minus) {
         throw std::invalid_argument("Two \"-\" before word");
     }
-    return {std::move(text), is_minus, std::move(IsStopWord(text))};
+    if ((text[0] == '-' || text[0] == '+') && (is_minus || is_required)) {
+        throw std::invalid_argument("Two operators before word");
+    }
+    const size_t tilde = text.rfind('~');
+    if (tilde != text.npos &&
+        (tilde + 1 == text.size() || (tilde + 2 == text.size() && text.back() >= '0' && text.back() <= '9'))) {
+        const bool is_auto = tilde + 1 == text.size();
+        max_distance = is_auto ? 0 : text.back() - '0';
+        text = text.substr(0, tilde);
+        if (text.empty()) {
+            throw std::invalid_argument("There isn't word before \"~\"");
+        }
+        if (max_distance > MAX_FUZZY_DISTANCE) {
+            throw std::invalid_argument("Too large edit distance of a fuzzy word");
+        }
+        if (is_required || text.back() == '*') {
+            throw std::invalid_argument("Fuzzy word can't be required or prefix");
+        }
+        if (is_auto) {
+            // Short words take fewer typos
+            const size_t length = CountCodePoints(text);
+            max_distance = length <= 2 ? 0 : length <= 5 ? 1 : 2;
+        }
+    }
+    if (text.back() == '*') {
+        is_prefix = true;
+        text.remove_suffix(1);
+        if (text.empty()) {
+            throw std::invalid_argument("There isn't word before \"*\"");
+        }
+        if (is_required) {
+            throw std::invalid_argument("Prefix word can't be required");
+        }
+    }
+    return {std::move(text), is_minus, is_required, is_prefix, max_distance};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const {
-    Query query;
+SearchServer::Query SearchServer::ParseQuery(const std::string_view& text, std::pmr::memory_resource* resource) const {
+    Query query(resource);
     auto& minus = query.minus_words;
     auto& plus = query.plus_words;
+    auto& required = query.required_words;
+    // Plus words with their weights, duplicates included
+    std::pmr::vector<std::pair<std::string_view, double>> weighted_plus(resource);
 
-    auto v = SplitIntoWordsView(text);
+    auto v = SplitIntoWordsView(text, resource);
     minus.reserve(v.size());
     minus.reserve(v.size());
 
+    // Operators are parsed before normalization turns them into spaces, then the rest of the word is folded in place
+    query.text.assign(text.begin(), text.end());
     for (std::string_view& word : std::move(v)) {
         const QueryWord& query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            query_word.is_minus
-            ? minus.push_back(query_word.data)
-            : plus.push_back(query_word.data);
+        char* normalized = query.text.data() + (query_word.data.data() - text.data());
+        NormalizeText(normalized, query_word.data.size());
+        const auto pieces = SplitIntoWordsView(std::string_view(normalized, query_word.data.size()), resource);
+        if (pieces.empty() && (query_word.is_prefix || query_word.max_distance >= 0)) {
+            throw std::invalid_argument(query_word.is_prefix ? "There isn't word before \"*\"" : "There isn't word before \"~\"");
         }
+
+        // A word split by punctuation gives words with the same operators, a prefix or typos apply to the last of them
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            const std::string_view piece = pieces[i];
+            const bool is_last = i + 1 == pieces.size();
+            if (is_last && query_word.is_prefix) {
+                ExpandPrefix(piece, query_word.is_minus ? minus : plus);
+            } else if (is_last && query_word.max_distance >= 0) {
+                std::pmr::vector<std::pair<std::string_view, double>> expansions(resource);
+                ExpandFuzzy(piece, query_word.max_distance, expansions, resource);
+                for (const auto& expansion : expansions) {
+                    query_word.is_minus
+                    ? minus.push_back(expansion.first)
+                    : weighted_plus.push_back(expansion);
+                }
+            } else if (!IsStopWord(piece)) {
+                query_word.is_minus
+                ? minus.push_back(piece)
+                : plus.push_back(piece);
+                if (query_word.is_required) {
+                    required.push_back(piece);
+                }
+            }
+        }
+    }
+    for (const std::string_view& word : plus) {
+        weighted_plus.emplace_back(word, 1.0);
     }
 
     std::sort(minus.begin(), minus.end());
     auto last_minus = std::unique(minus.begin(), minus.end());
     minus.erase(last_minus, minus.end());
 
-    std::sort(plus.begin(), plus.end());
-    auto last_plus = std::unique(plus.begin(), plus.end());
-    plus.erase(last_plus, plus.end());
+    // A word met several times keeps its largest weight
+    std::sort(weighted_plus.begin(), weighted_plus.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first != rhs.first ? lhs.first < rhs.first : lhs.second > rhs.second;
+    });
+    auto last_plus = std::unique(weighted_plus.begin(), weighted_plus.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+    });
+    plus.clear();
+    for (auto it = weighted_plus.begin(); it != last_plus; ++it) {
+        plus.push_back(it->first);
+        query.plus_weights.push_back(it->second);
+    }
+
+    std::sort(required.begin(), required.end());
+    auto last_required = std::unique(required.begin(), required.end());
+    required.erase(last_required, required.end());
 
     return query;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::execution::parallel_policy policy, const std::string_view& text) const {
-    Query query;
-    auto& minus = query.minus_words;
-    auto& plus = query.plus_words;
+void SearchServer::ExpandPrefix(std::string_view prefix, std::pmr::vector<std::string_view>& words) const {
+    int expansion_count = 0;
+    term_dictionary_.ForEachWithPrefix(prefix, [&](int term_id) {
+        // Terms left only in removed documents don't take up the expansion limit
+        if (document_freqs_[term_id] > 0) {
+            words.push_back(term_dictionary_.GetTerm(term_id));
+            ++expansion_count;
+        }
+        return expansion_count < MAX_PREFIX_EXPANSION_COUNT;
+    });
+}
 
-    auto v = SplitIntoWordsView(text);
-    minus.reserve(v.size());
-    minus.reserve(v.size());
+void SearchServer::ExpandFuzzy(std::string_view word,
+                               int max_distance,
+                               std::pmr::vector<std::pair<std::string_view, double>>& words,
+                               std::pmr::memory_resource* resource) const {
+    // A word of n code points takes at most n - 1 edits, so every expansion keeps a positive weight
+    const int length = static_cast<int>(CountCodePoints(word));
+    max_distance = std::min(max_distance, length - 1);
+    auto matches = term_dictionary_.FindWithinDistance(word, max_distance, resource);
+    matches.erase(std::remove_if(matches.begin(), matches.end(), [this](const TermDictionary::TermMatch& match) {
+        return document_freqs_[match.term_id] == 0;
+    }), matches.end());
+    const auto last = matches.begin() + std::min<size_t>(matches.size(), MAX_FUZZY_EXPANSION_COUNT);
+    std::partial_sort(matches.begin(), last, matches.end(), [this](const TermDictionary::TermMatch& lhs, const TermDictionary::TermMatch& rhs) {
+        return lhs.distance != rhs.distance ? lhs.distance < rhs.distance : document_freqs_[lhs.term_id] > document_freqs_[rhs.term_id];
+    });
 
-    for (std::string_view& word : std::move(v)) {
-        const QueryWord& query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            query_word.is_minus
-            ? minus.push_back(query_word.data)
-            : plus.push_back(query_word.data);
-        }
+    for (auto it = matches.begin(); it != last; ++it) {
+        words.emplace_back(term_dictionary_.GetTerm(it->term_id), 1.0 - static_cast<double>(it->distance) / length);
     }
-
-    return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeInverseDocumentFreq(int term_id) const {
+    return std::log(GetDocumentCount() * 1.0 / document_freqs_[term_id]);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy,
@@ -214,26 +862,472 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy,
                                                                                       const std::string_view& raw_query,
                                                                                       int document_id) const {
-    Query query = ParseQuery(policy, raw_query);
-    auto& minus = query.minus_words;
-    auto& plus = query.plus_words;
+    // A single document is matched by one merge pass, there is nothing worth splitting
+    return MatchDocument(raw_query, document_id);
+}
 
-    if (std::any_of(minus.begin(), minus.end(), [&](const std::string_view& word) {
-        return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id) != 0;
-    })
-            ) {
-        return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+SearchServer::QueryTerms SearchServer::GetQueryTerms(const Query& query, std::pmr::memory_resource* resource) const {
+    QueryTerms terms(resource);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = GetTermId(query.plus_words[i]);
+        if (term_id >= 0) {
+            terms.plus_terms.emplace_back(term_id, static_cast<int>(i));
+        }
     }
+    for (const std::string_view& word : query.minus_words) {
+        const int term_id = GetTermId(word);
+        if (term_id >= 0) {
+            terms.minus_terms.push_back(term_id);
+        }
+    }
+    // A required word missing from the index keeps its -1, which no document contains
+    for (const std::string_view& word : query.required_words) {
+        terms.required_terms.push_back(GetTermId(word));
+    }
+    std::sort(terms.plus_terms.begin(), terms.plus_terms.end());
+    std::sort(terms.minus_terms.begin(), terms.minus_terms.end());
+    std::sort(terms.required_terms.begin(), terms.required_terms.end());
+    return terms;
+}
 
-    std::vector<std::string_view> matched_words(plus.size());
-    auto last = std::copy_if(std::execution::par, plus.begin(), plus.end(), matched_words.begin(), [&](const std::string_view& word) {
-        return word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id) != 0;
+namespace {
+
+// Exponential search for the first entry with term id not less than term_id
+const TermFrequency* GallopTo(const TermFrequency* first, const TermFrequency* last, int term_id) {
+    size_t step = 1;
+    while (step < static_cast<size_t>(last - first) && first[step].term_id < term_id) {
+        first += step;
+        step *= 2;
+    }
+    const TermFrequency* bound = first + std::min(step + 1, static_cast<size_t>(last - first));
+    return std::lower_bound(first, bound, term_id, [](const TermFrequency& entry, int term_id) {
+        return entry.term_id < term_id;
     });
-    matched_words.erase(last, matched_words.end());
+}
+
+} // namespace
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(AdaptiveExecutionPolicy policy,
+                                                                                      const std::string_view& raw_query,
+                                                                                      int document_id) const {
+    return MatchDocument(raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(AdaptiveExecutionPolicy policy,
+                                                                                                    const std::string_view& raw_query,
+                                                                                                    const std::vector<int>& document_ids) const {
+    // Every document costs about one probe of its forward index per query word
+    const size_t word_count = SplitIntoWordsView(raw_query).size();
+    return IsParallelWorthIt(document_ids.size() * word_count)
+           ? MatchDocuments(std::execution::par, raw_query, document_ids)
+           : MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
+bool SearchServer::IsParallelWorthIt(size_t work) const {
+    const ExecutionThresholds& thresholds = are_execution_thresholds_set_ ? execution_thresholds_ : GetExecutionThresholds();
+    return work >= thresholds.GetMinParallelWork(thread_pool_->GetThreadCount());
+}
+
+ExecutionPath SearchServer::ChooseExecutionPath(const std::pmr::vector<SegmentQuery>& segment_queries) const {
+    size_t work = 0;
+    size_t largest_work = 0;
+    for (const SegmentQuery& segment_query : segment_queries) {
+        work += segment_query.work;
+        largest_work = std::max(largest_work, segment_query.work);
+    }
+    if (!IsParallelWorthIt(work)) {
+        return ExecutionPath::SEQUENTIAL;
+    }
+
+    // Whole segments are only balanced when no segment dominates
+    const size_t thread_count = thread_pool_->GetThreadCount();
+    if (segment_queries.size() >= thread_count && largest_work * thread_count <= work) {
+        return ExecutionPath::PARALLEL_SEGMENTS;
+    }
+    return ExecutionPath::PARALLEL_CHUNKS;
+}
+
+void SearchServer::ExplainWords(const Query& query, QueryExplain& explain) const {
+    auto add_word = [&](std::string_view word, bool is_minus, double weight) {
+        ExplainWord& explain_word = explain.words.emplace_back();
+        explain_word.word = std::string(word);
+        explain_word.is_minus = is_minus;
+        explain_word.is_required = !is_minus && std::binary_search(query.required_words.begin(), query.required_words.end(), word);
+        explain_word.weight = weight;
+        const int term_id = GetTermId(word);
+        if (term_id >= 0 && document_freqs_[term_id] > 0) {
+            explain_word.posting_count = document_freqs_[term_id];
+            explain_word.inverse_document_freq = ComputeInverseDocumentFreq(term_id);
+        }
+    };
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        add_word(query.plus_words[i], false, query.plus_weights[i]);
+    }
+    for (const std::string_view& word : query.minus_words) {
+        add_word(word, true, 1.0);
+    }
+}
+
+std::pmr::vector<std::shared_ptr<const IndexSegment>> SearchServer::GetSegments(std::pmr::memory_resource* resource) const {
+    std::lock_guard guard(segments_guard_);
+    return std::pmr::vector<std::shared_ptr<const IndexSegment>>(segments_.begin(), segments_.end(), resource);
+}
+
+std::pmr::vector<SearchServer::SegmentQuery> SearchServer::PrepareSegmentQueries(const Query& query,
+                                                                                 const std::pmr::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                                                 std::pmr::memory_resource* resource) const {
+    struct PlusTerm {
+        int term_id;
+        double inverse_document_freq;
+        double weight;
+        bool is_required;
+        size_t word_index;
+    };
+    std::pmr::vector<SegmentQuery> segment_queries(resource);
+
+    // Words missing from the index are dropped, IDF of the rest is computed once for all segments
+    std::pmr::vector<PlusTerm> plus_terms(resource);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const std::string_view word = query.plus_words[i];
+        const int term_id = GetTermId(word);
+        const bool is_required = std::binary_search(query.required_words.begin(), query.required_words.end(), word);
+        if (term_id >= 0 && document_freqs_[term_id] > 0) {
+            const double inverse_document_freq = ComputeInverseDocumentFreq(term_id);
+            plus_terms.push_back({term_id, inverse_document_freq, inverse_document_freq * query.plus_weights[i], is_required, i});
+        } else if (is_required) {
+            return segment_queries;
+        }
+    }
+    std::pmr::vector<int> minus_terms(resource);
+    for (const std::string_view& word : query.minus_words) {
+        const int term_id = GetTermId(word);
+        if (term_id >= 0 && document_freqs_[term_id] > 0) {
+            minus_terms.push_back(term_id);
+        }
+    }
 
-    std::sort(matched_words.begin(), matched_words.end());
-    auto last_plus = std::unique(matched_words.begin(), matched_words.end());
-    matched_words.erase(last_plus, matched_words.end());
+    // Impacts score a segment only if none of its plus words drifted or carries a weight of its own
+    auto attach_impacts = [&](const IndexSegment& segment, SegmentQuery& segment_query) {
+        std::shared_ptr<const SegmentImpacts> impacts = segment.GetImpacts();
+        if (impacts == nullptr || impacts->GetPrecision() != impact_precision_) {
+            return;
+        }
+        size_t index = 0;
+        for (const PlusTerm& term : plus_terms) {
+            const int term_index = segment.FindTerm(term.term_id);
+            if (term_index < 0) {
+                continue;
+            }
+            if (term.weight != term.inverse_document_freq
+                || !IsImpactFresh(impacts->GetInverseDocumentFreq(term_index), term.inverse_document_freq)) {
+                return;
+            }
+            auto& plus_postings = segment_query.plus_postings[index++];
+            plus_postings.impacts = impacts->GetImpacts(segment.GetPostingOffset(plus_postings.postings));
+        }
+        segment_query.impacts = std::move(impacts);
+    };
+
+    segment_queries.reserve(segments.size() + 1);
+    auto add_segment = [&](const auto& segment) {
+        SegmentQuery segment_query(resource);
+        for (const PlusTerm& term : plus_terms) {
+            const PostingList postings = segment.GetPostings(term.term_id);
+            if (postings.size > 0) {
+                if (term.is_required) {
+                    segment_query.required_order.push_back(segment_query.plus_postings.size());
+                }
+                segment_query.plus_postings.push_back({postings, term.weight, term.is_required, term.word_index});
+                segment_query.work += postings.size;
+            } else if (term.is_required) {
+                return;
+            }
+        }
+        if (segment_query.plus_postings.empty()) {
+            return;
+        }
+        for (const int term_id : minus_terms) {
+            const PostingList postings = segment.GetPostings(term_id);
+            if (postings.size > 0) {
+                segment_query.minus_postings.push_back(postings);
+                segment_query.work += postings.size;
+            }
+        }
+
+        // Intersection is driven by the rarest required word, every other list is skipped through
+        auto& required_order = segment_query.required_order;
+        std::sort(required_order.begin(), required_order.end(), [&](size_t lhs, size_t rhs) {
+            return segment_query.plus_postings[lhs].postings.size < segment_query.plus_postings[rhs].postings.size;
+        });
+        segment_query.is_intersection = !required_order.empty();
+        if (!required_order.empty()) {
+            const size_t list_count = segment_query.plus_postings.size() + segment_query.minus_postings.size();
+            segment_query.work = std::min(segment_query.work, segment_query.plus_postings[required_order.front()].postings.size * list_count);
+        }
+        segment_query.first_internal_id = segment.GetFirstInternalId();
+        segment_query.last_internal_id = segment.GetLastInternalId();
+        if constexpr (std::is_same_v<std::decay_t<decltype(segment)>, IndexSegment>) {
+            if (impact_precision_ != ImpactPrecision::NONE) {
+                attach_impacts(segment, segment_query);
+            }
+        }
+        segment_queries.push_back(std::move(segment_query));
+    };
+    for (const auto& segment : segments) {
+        add_segment(*segment);
+    }
+    add_segment(mutable_segment_);
+    return segment_queries;
+}
+
+bool SearchServer::IsFilterIndexWorthIt(const DocumentFilter& filter, const std::pmr::vector<SegmentQuery>& segment_queries) const {
+    // The id set is never checked per document
+    if (filter.document_ids.has_value()) {
+        return true;
+    }
+    size_t work = 0;
+    size_t list_count = 0;
+    for (const SegmentQuery& segment_query : segment_queries) {
+        work += segment_query.work;
+        list_count = std::max(list_count, segment_query.plus_postings.size() + segment_query.minus_postings.size());
+    }
+    // Every document of the filter costs its collection and a probe of each list
+    return rating_index_.CountInRange(filter.min_rating, filter.max_rating) * (list_count + 1) < work;
+}
+
+std::pmr::vector<int> SearchServer::FilterDocuments(const DocumentFilter& filter, std::pmr::memory_resource* resource) const {
+    std::pmr::vector<int> filtered_ids(resource);
+    // Stale entries of the rating index are caught here, as the rating no longer matches or the document is removed
+    auto add_document = [&](int internal_id) {
+        const DocumentData& document_data = documents_[internal_id];
+        if (!document_data.is_removed && filter.IsMatch(document_data.status, document_data.rating)) {
+            filtered_ids.push_back(internal_id);
+        }
+    };
+    if (filter.document_ids.has_value()) {
+        for (const int document_id : *filter.document_ids) {
+            const auto it = internal_ids_.find(document_id);
+            if (it != internal_ids_.end()) {
+                add_document(it->second);
+            }
+        }
+    } else {
+        rating_index_.ForEachInRange(filter.min_rating, filter.max_rating, add_document);
+    }
+    std::sort(filtered_ids.begin(), filtered_ids.end());
+    filtered_ids.erase(std::unique(filtered_ids.begin(), filtered_ids.end()), filtered_ids.end());
+    return filtered_ids;
+}
+
+void SearchServer::ApplyFilter(const std::pmr::vector<int>& filtered_ids, std::pmr::vector<SegmentQuery>& segment_queries) const {
+    for (SegmentQuery& segment_query : segment_queries) {
+        const auto first = std::lower_bound(filtered_ids.begin(), filtered_ids.end(), segment_query.first_internal_id);
+        const auto last = std::lower_bound(first, filtered_ids.end(), segment_query.last_internal_id);
+        segment_query.filter.internal_ids = filtered_ids.data() + (first - filtered_ids.begin());
+        segment_query.filter.size = last - first;
+        segment_query.is_filtered = true;
+        // The filter drives the scoring as the rarest required word does, once its probes cost less than the merge
+        const size_t list_count = segment_query.plus_postings.size() + segment_query.minus_postings.size();
+        if (segment_query.filter.size * list_count < segment_query.work) {
+            segment_query.work = segment_query.filter.size * list_count;
+            segment_query.is_intersection = true;
+        }
+    }
+    segment_queries.erase(std::remove_if(segment_queries.begin(), segment_queries.end(), [](const SegmentQuery& segment_query) {
+                              return segment_query.filter.size == 0;
+                          }),
+                          segment_queries.end());
+}
+
+bool SearchServer::IsDenseScoringWorthIt(const SegmentQuery& segment_query, const ScoringRange& range) const {
+    if (segment_query.is_intersection || segment_query.plus_postings.size() < 2) {
+        return false;
+    }
+    size_t posting_count = 0;
+    for (const auto& plus_postings : segment_query.plus_postings) {
+        if (plus_postings.weight <= 0.0) {
+            return false;
+        }
+        posting_count += plus_postings.postings.size;
+    }
+    // Postings of a chunk are taken in proportion to its share of the segment
+    const double range_share = static_cast<double>(range.last_internal_id - range.first_internal_id)
+                               / (segment_query.last_internal_id - segment_query.first_internal_id);
+    return posting_count * range_share >= execution_thresholds_.min_dense_scoring_density
+                                          * (range.last_internal_id - range.first_internal_id);
+}
+
+std::pmr::vector<SearchServer::ScoringRange> SearchServer::SplitIntoScoringRanges(const std::pmr::vector<SegmentQuery>& segment_queries,
+                                                                                  ExecutionPath path,
+                                                                                  std::pmr::memory_resource* resource) const {
+    std::pmr::vector<ScoringRange> ranges(resource);
+    size_t work = 0;
+    for (const SegmentQuery& segment_query : segment_queries) {
+        work += segment_query.work;
+    }
+    const size_t thread_count = thread_pool_->GetThreadCount();
+
+    for (size_t index = 0; index < segment_queries.size(); ++index) {
+        const SegmentQuery& segment_query = segment_queries[index];
+        if (path != ExecutionPath::PARALLEL_CHUNKS) {
+            ranges.push_back({index, segment_query.first_internal_id, segment_query.last_internal_id});
+            continue;
+        }
+
+        // Chunk bounds split evenly the posting list that drives the scoring
+        const PostingList* longest_postings = &segment_query.plus_postings.front().postings;
+        for (const auto& plus_postings : segment_query.plus_postings) {
+            if (plus_postings.postings.size > longest_postings->size) {
+                longest_postings = &plus_postings.postings;
+            }
+        }
+        if (!segment_query.required_order.empty()) {
+            longest_postings = &segment_query.plus_postings[segment_query.required_order.front()].postings;
+        }
+        if (segment_query.is_intersection && segment_query.is_filtered
+            && (segment_query.required_order.empty() || segment_query.filter.size < longest_postings->size)) {
+            longest_postings = &segment_query.filter;
+        }
+        const size_t chunk_count = std::clamp<size_t>((thread_count * segment_query.work + work - 1) / work, 1, longest_postings->size);
+        const size_t chunk_size = (longest_postings->size + chunk_count - 1) / chunk_count;
+        int first_internal_id = segment_query.first_internal_id;
+        for (size_t position = chunk_size; position < longest_postings->size; position += chunk_size) {
+            const int last_internal_id = longest_postings->internal_ids[position];
+            ranges.push_back({index, first_internal_id, last_internal_id});
+            first_internal_id = last_internal_id;
+        }
+        ranges.push_back({index, first_internal_id, segment_query.last_internal_id});
+    }
+    return ranges;
+}
+
+std::vector<char> SearchServer::GetRemovedFlags(int first_internal_id, int last_internal_id) const {
+    std::vector<char> is_removed(last_internal_id - first_internal_id);
+    for (int internal_id = first_internal_id; internal_id < last_internal_id; ++internal_id) {
+        is_removed[internal_id - first_internal_id] = documents_[internal_id].is_removed;
+    }
+    return is_removed;
+}
+
+size_t SearchServer::FindMergeCandidates() const {
+    size_t first = 0;
+    for (size_t i = 1; i <= segments_.size(); ++i) {
+        if (i == segments_.size() || segments_[i]->GetTier() != segments_[first]->GetTier()) {
+            if (i - first >= SEGMENT_MERGE_FACTOR) {
+                return first;
+            }
+            first = i;
+        }
+    }
+    return segments_.size();
+}
+
+void SearchServer::ScheduleMerge() {
+    if (is_merging_ || FindMergeCandidates() == segments_.size()) {
+        return;
+    }
+    is_merging_ = true;
+    merge_ = thread_pool_->Submit([this] {
+        MergeSegments();
+    }, TaskPriority::LOW);
+}
+
+void SearchServer::MergeSegments() {
+    std::unique_lock lock(segments_guard_);
+    while (true) {
+        const size_t first = FindMergeCandidates();
+        if (first == segments_.size()) {
+            is_merging_ = false;
+            return;
+        }
+        const std::vector<std::shared_ptr<const IndexSegment>> inputs(segments_.begin() + first,
+                                                                      segments_.begin() + first + SEGMENT_MERGE_FACTOR);
+        const std::vector<char> is_removed = GetRemovedFlags(inputs.front()->GetFirstInternalId(), inputs.back()->GetLastInternalId());
+
+        // Only this task replaces segments, so the inputs are still in place when it's done
+        lock.unlock();
+        std::shared_ptr<const IndexSegment> merged = IndexSegment::Merge(inputs, is_removed, &sealed_segments_resource_);
+        lock.lock();
+
+        const auto it = std::find(segments_.begin(), segments_.end(), inputs.front());
+        *it = std::move(merged);
+        segments_.erase(it + 1, it + SEGMENT_MERGE_FACTOR);
+    }
+}
+
+void SearchServer::RefreshImpacts() {
+    if (impact_precision_ == ImpactPrecision::NONE) {
+        return;
+    }
+    // IDFs are read on the writer side, so a segment merged in the background meanwhile just waits for the next refresh
+    for (const auto& segment : GetSegments(std::pmr::get_default_resource())) {
+        const std::pmr::vector<int>& term_ids = segment->GetTermIds();
+        std::vector<double> inverse_document_freqs(term_ids.size(), 0.0);
+        for (size_t i = 0; i < term_ids.size(); ++i) {
+            // Terms left only in removed documents are never queried
+            if (document_freqs_[term_ids[i]] > 0) {
+                inverse_document_freqs[i] = ComputeInverseDocumentFreq(term_ids[i]);
+            }
+        }
+
+        const std::shared_ptr<const SegmentImpacts> impacts = segment->GetImpacts();
+        bool is_fresh = impacts != nullptr && impacts->GetPrecision() == impact_precision_;
+        for (size_t i = 0; is_fresh && i < term_ids.size(); ++i) {
+            is_fresh = IsImpactFresh(impacts->GetInverseDocumentFreq(static_cast<int>(i)), inverse_document_freqs[i]);
+        }
+        if (!is_fresh) {
+            segment->SetImpacts(SegmentImpacts::Compute(*segment, impact_precision_, std::move(inverse_document_freqs), &sealed_segments_resource_));
+        }
+    }
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchQueryTerms(const Query& query,
+                                                                                        const QueryTerms& terms,
+                                                                                        int document_id) const {
+    const int internal_id = internal_ids_.at(document_id);
+    const DocumentData& document_data = documents_[internal_id];
+    const TermFrequency* const first = GetDocumentTermsBegin(internal_id);
+    const TermFrequency* const last = GetDocumentTermsEnd(internal_id);
+
+    const TermFrequency* it = first;
+    for (const int term_id : terms.minus_terms) {
+        it = GallopTo(it, last, term_id);
+        if (it == last) {
+            break;
+        }
+        if (it->term_id == term_id) {
+            return {std::vector<std::string_view>{}, document_data.status};
+        }
+    }
+
+    it = first;
+    for (const int term_id : terms.required_terms) {
+        it = GallopTo(it, last, term_id);
+        if (it == last || it->term_id != term_id) {
+            return {std::vector<std::string_view>{}, document_data.status};
+        }
+    }
+
+    // Term id of every matched query word, -1 for the rest
+    std::vector<int> matched_terms(query.plus_words.size(), -1);
+    it = first;
+    for (const auto& [term_id, word_index] : terms.plus_terms) {
+        it = GallopTo(it, last, term_id);
+        if (it == last) {
+            break;
+        }
+        if (it->term_id == term_id) {
+            matched_terms[word_index] = term_id;
+        }
+    }
+
+    // Reported in the sorted order of the query words, pointing into the index
+    std::vector<std::string_view> matched_words;
+    for (const int term_id : matched_terms) {
+        if (term_id >= 0) {
+            matched_words.push_back(term_dictionary_.GetTerm(term_id));
+        }
+    }
 
-    return {std::move(matched_words), documents_.at(document_id).status};
+    return {std::move(matched_words), document_data.status};
 }
@@ -6,24 +6,53 @@
 #include <map>
 #include <algorithm>
 #include <execution>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <unordered_map>
+#include <optional>
 
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "word_frequencies.h"
+#include "index_segment.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+#include "execution_plan.h"
+#include "memory_resources.h"
+#include "write_ahead_log.h"
+#include "score_kernels.h"
+#include "query_budget.h"
+#include "rating_index.h"
+#include "facet_counts.h"
+#include "query_explain.h"
+#include "memory_budget.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double MIN_RELEVANCE_DIFFERENCE = 1e-6;
-const int NUMBER_THREADS = 12;
+const int MAX_PREFIX_EXPANSION_COUNT = 64;
+const int MAX_FUZZY_DISTANCE = 2;
+const int MAX_FUZZY_EXPANSION_COUNT = 64;
+// Terms found in at least this many documents keep a champion list
+const int CHAMPION_LIST_MIN_DOCUMENT_FREQ = 512;
+const size_t CHAMPION_LIST_SIZE = 64;
 
 class SearchServer {
 public:
+    // index_resource must be thread-safe, background merges allocate from it too
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
-    explicit SearchServer(const std::string& stop_words_text);
-    explicit SearchServer(const std::string_view& stop_words_view);
+    explicit SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* index_resource = nullptr);
+    explicit SearchServer(const std::string& stop_words_text, std::pmr::memory_resource* index_resource = nullptr);
+    explicit SearchServer(const std::string_view& stop_words_view, std::pmr::memory_resource* index_resource = nullptr);
+    ~SearchServer();
 
     void AddDocument(int document_id, const std::string_view& document, const DocumentStatus& status, const std::vector<int>& ratings);
+    // Postings stay as they are. Throws std::out_of_range if there is no such document.
+    void UpdateDocumentAttributes(int document_id, const DocumentStatus& status, const std::vector<int>& ratings);
+    // Keeps the status and the rating. Throws std::out_of_range if there is no such document.
+    void UpdateDocument(int document_id, const std::string_view& document);
 
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const;
@@ -33,16 +62,99 @@ public:
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const;
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+    // Actual documents, reuses the capacity of documents
+    void FindTopDocuments(std::execution::sequenced_policy, const std::string_view& raw_query, std::vector<Document>& documents) const;
+
+    // Returns the best documents found so far once the budget is exhausted
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           QueryBudget& budget) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentStatus& status,
+                                           QueryBudget& budget) const;
+
+    // Counts every match into the facets, reset first
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           FacetCounts& facets) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentStatus& status,
+                                           FacetCounts& facets) const;
+
+    // Fills the explain record, reset first
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           QueryExplain& explain) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentStatus& status,
+                                           QueryExplain& explain) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentFilter& filter) const;
+
+    // Documents ranked right after the cursor, the first page without one. The index must not change between the pages.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsAfter(const std::string_view& raw_query, const std::optional<Document>& cursor, size_t page_size,
+                                                DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsAfter(const std::string_view& raw_query, const std::optional<Document>& cursor, size_t page_size,
+                                                const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsAfter(ExecutionPolicy&& policy, const std::string_view& raw_query, const std::optional<Document>& cursor,
+                                                size_t page_size, DocumentPredicate document_predicate) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsAfter(ExecutionPolicy&& policy, const std::string_view& raw_query, const std::optional<Document>& cursor,
+                                                size_t page_size, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+
+    // Unless set, the costs are calibrated on the first adaptive_execution query
+    void SetExecutionThresholds(const ExecutionThresholds& thresholds);
+
+    // The thread pool of the server must outlive the future
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> FindTopDocumentsAsync(const std::string_view& raw_query, DocumentPredicate document_predicate, TaskPriority priority = TaskPriority::NORMAL) const;
+    std::future<std::vector<Document>> FindTopDocumentsAsync(const std::string_view& raw_query, const DocumentStatus& status = DocumentStatus::ACTUAL, TaskPriority priority = TaskPriority::NORMAL) const;
+
+    // The pool must outlive the server
+    void SetThreadPool(ThreadPool& thread_pool);
+    ThreadPool& GetThreadPool() const;
+
+    // The log must outlive the server or be detached first
+    void SetWriteAheadLog(WriteAheadLog* write_ahead_log);
+    // The changes made by changes() wait for one sync of the write-ahead log at the end instead of one each
+    template <typename Function>
+    void RunWriteBatch(Function changes);
+
+    // Sealed segments are scored by quantized term_freq * IDF, fuzzy words and stale impacts exactly
+    void SetImpactPrecision(ImpactPrecision precision);
+
+    void FlushSegment();
+    void WaitForMerges();
+    // Merges all segments into one, dropping the postings of removed documents
+    void Compact();
+    // Compact that also renumbers the documents in the order of their MinHash signatures, external ids don't change
+    void ReorderDocuments();
+    MemoryStats GetMemoryStats() const;
+    // AddDocument and UpdateDocument check the budget before they change anything
+    void SetMemoryBudget(const MemoryBudget& budget);
+    size_t GetDeltaEncodedPostingBits() const;
+    size_t GetSegmentCount() const;
 
     int GetDocumentCount() const;
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    std::pmr::set<int>::const_iterator begin() const;
+    std::pmr::set<int>::const_iterator end() const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, const std::string_view& raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(AdaptiveExecutionPolicy, const std::string_view& raw_query, int document_id) const;
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view& raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::sequenced_policy, const std::string_view& raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::parallel_policy, const std::string_view& raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(AdaptiveExecutionPolicy, const std::string_view& raw_query, const std::vector<int>& document_ids) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // The view is invalidated by AddDocument and RemoveDocument
+    WordFrequencies GetWordFrequencies(int document_id) const;
 
     template<class ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
@@ -50,53 +162,271 @@ public:
 
 private:
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
+        bool is_removed;
+    };
+
+    std::unique_ptr<std::pmr::synchronized_pool_resource> own_index_resource_;
+    std::pmr::memory_resource* index_resource_;
+    CountingResource words_resource_{index_resource_};
+    CountingResource forward_index_resource_{index_resource_};
+    CountingResource documents_resource_{index_resource_};
+    CountingResource ids_resource_{index_resource_};
+    CountingResource champion_lists_resource_{index_resource_};
+    CountingResource rating_index_resource_{index_resource_};
+    CountingResource mutable_segment_resource_{index_resource_};
+    CountingResource sealed_segments_resource_{index_resource_};
+
+    std::pmr::set<std::pmr::string, std::less<>> stop_words_{&words_resource_};
+    TermDictionary term_dictionary_{&words_resource_};
+    // By term id
+    std::pmr::vector<int> document_freqs_{&words_resource_};
+
+    // Internal ids are never reused, ReorderDocuments renumbers them all
+    std::pmr::map<int, int> internal_ids_{&ids_resource_};
+    // Removed documents included
+    std::pmr::vector<DocumentData> documents_{&documents_resource_};
+    // Terms of internal id i, sorted by term id, are [document_word_offsets_[i], document_word_offsets_[i + 1])
+    std::pmr::vector<TermFrequency> document_word_freq_{&forward_index_resource_};
+    std::pmr::vector<size_t> document_word_offsets_ = std::pmr::vector<size_t>(1, 0, &forward_index_resource_);
+    std::pmr::set<int> ids_{&ids_resource_};
+
+    // Every live document with the term outside the list has a term frequency of at most boundary_term_freq
+    struct ChampionList {
+        struct Entry {
+            double term_freq;
+            int internal_id;
+        };
+
+        explicit ChampionList(std::pmr::memory_resource* resource)
+        : entries(resource)
+        {
+        }
+
+        void Offer(const Entry& entry);
+        bool Remove(int internal_id);
+
+        std::pmr::vector<Entry> entries;
+        double boundary_term_freq = 0.0;
     };
+    std::pmr::unordered_map<int, ChampionList> champion_lists_{&champion_lists_resource_};
+    RatingIndex rating_index_{&rating_index_resource_};
 
-    std::set<std::string, std::less<>> stop_words_;
-    std::set<std::string, std::less<>> words_documents_;
+    MutableSegment mutable_segment_{0, &mutable_segment_resource_};
+    // Guards segments_ and the removal flags read by the background merge
+    mutable std::mutex segments_guard_;
+    std::vector<std::shared_ptr<const IndexSegment>> segments_;
+    bool is_merging_ = false;
+    std::future<void> merge_;
 
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::map<int, std::map<std::string_view, double>> document_word_freq_;
-    std::set<int> ids_;
+    ThreadPool* thread_pool_ = &GetDefaultThreadPool();
+    WriteAheadLog* write_ahead_log_ = nullptr;
+    ImpactPrecision impact_precision_ = ImpactPrecision::NONE;
+    MemoryBudget memory_budget_;
+    size_t removed_since_compaction_ = 0;
+    ExecutionThresholds execution_thresholds_;
+    bool are_execution_thresholds_set_ = false;
 
     static bool IsValidWord(const std::string_view& word);
     bool IsStopWord(const std::string_view& word) const;
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text) const;
+    std::pmr::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text, std::pmr::vector<char>& normalized_text) const;
     static int ComputeAverageRating(const std::vector<int>& ratings);
+    void AppendDocumentTerms(const std::string_view& document);
+    int GetTermId(const std::string_view& word) const;
+    const TermFrequency* GetDocumentTermsBegin(int internal_id) const;
+    const TermFrequency* GetDocumentTermsEnd(int internal_id) const;
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+    void AddToChampionLists(int internal_id);
+    void RemoveFromChampionLists(int internal_id);
+    void RebuildChampionList(int term_id, ChampionList& list) const;
+    void MarkRatingStale();
+    void RebuildRatingIndex();
 
     struct QueryWord {
         std::string_view data;
         bool is_minus;
-        bool is_stop;
+        bool is_required;
+        bool is_prefix;
+        // -1 unless the word is fuzzy
+        int max_distance;
     };
     QueryWord ParseQueryWord(std::string_view text) const;
 
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        explicit Query(std::pmr::memory_resource* resource)
+        : text(resource)
+        , plus_words(resource)
+        , plus_weights(resource)
+        , minus_words(resource)
+        , required_words(resource)
+        {
+        }
+
+        // The words point into the normalized text or into the dictionary
+        std::pmr::vector<char> text;
+        std::pmr::vector<std::string_view> plus_words;
+        std::pmr::vector<double> plus_weights;
+        std::pmr::vector<std::string_view> minus_words;
+        // Plus words as well
+        std::pmr::vector<std::string_view> required_words;
+    };
+    // Word lists are sorted and unique, prefix and fuzzy words are replaced by their expansions
+    Query ParseQuery(const std::string_view& text, std::pmr::memory_resource* resource) const;
+    void ExpandPrefix(std::string_view prefix, std::pmr::vector<std::string_view>& words) const;
+    // A word at distance d from a word of n code points weighs 1 - d / n, d is capped at n - 1
+    void ExpandFuzzy(std::string_view word, int max_distance, std::pmr::vector<std::pair<std::string_view, double>>& words,
+                     std::pmr::memory_resource* resource) const;
+
+    struct QueryTerms {
+        explicit QueryTerms(std::pmr::memory_resource* resource)
+        : plus_terms(resource)
+        , minus_terms(resource)
+        , required_terms(resource)
+        {
+        }
+
+        // {term id, index in Query::plus_words}
+        std::pmr::vector<std::pair<int, int>> plus_terms;
+        std::pmr::vector<int> minus_terms;
+        std::pmr::vector<int> required_terms;
+    };
+    QueryTerms GetQueryTerms(const Query& query, std::pmr::memory_resource* resource) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchQueryTerms(const Query& query, const QueryTerms& terms, int document_id) const;
+
+    double ComputeInverseDocumentFreq(int term_id) const;
+
+    struct SegmentQuery {
+        explicit SegmentQuery(std::pmr::memory_resource* resource)
+        : plus_postings(resource)
+        , minus_postings(resource)
+        , required_order(resource)
+        {
+        }
+
+        struct PlusPostings {
+            PostingList postings;
+            // IDF times the weight of the word
+            double weight;
+            bool is_required;
+            size_t word_index;
+            const void* impacts = nullptr;
+        };
+
+        std::pmr::vector<PlusPostings> plus_postings;
+        std::pmr::vector<PostingList> minus_postings;
+        // From the shortest
+        std::pmr::vector<size_t> required_order;
+        PostingList filter;
+        bool is_filtered = false;
+        bool is_intersection = false;
+        int first_internal_id = 0;
+        int last_internal_id = 0;
+        size_t work = 0;
+        std::shared_ptr<const SegmentImpacts> impacts;
+    };
+
+    struct ScoringRange {
+        size_t segment_index;
+        int first_internal_id;
+        int last_internal_id;
+    };
+
+    struct TopSelection {
+        const Document* cursor = nullptr;
+        size_t count = MAX_RESULT_DOCUMENT_COUNT;
+        const DocumentFilter* filter = nullptr;
+        FacetCounts* facets = nullptr;
+        QueryExplain* explain = nullptr;
     };
-    Query ParseQuery(const std::string_view& text) const;
-    Query ParseQuery(std::execution::parallel_policy, const std::string_view& text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    class TopDocuments {
+    public:
+        TopDocuments(const TopSelection& selection, std::pmr::memory_resource* resource);
+
+        void Add(const Document& document);
+        // Leaves the heap empty
+        size_t Extract(Document* output);
+
+    private:
+        TopSelection selection_;
+        std::pmr::vector<Document> heap_;
+    };
 
+    void ExplainWords(const Query& query, QueryExplain& explain) const;
+    // A request keeps the segments alive while it runs
+    std::pmr::vector<std::shared_ptr<const IndexSegment>> GetSegments(std::pmr::memory_resource* resource) const;
+    std::pmr::vector<SegmentQuery> PrepareSegmentQueries(const Query& query,
+                                                         const std::pmr::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                         std::pmr::memory_resource* resource) const;
+    bool IsFilterIndexWorthIt(const DocumentFilter& filter, const std::pmr::vector<SegmentQuery>& segment_queries) const;
+    std::pmr::vector<int> FilterDocuments(const DocumentFilter& filter, std::pmr::memory_resource* resource) const;
+    void ApplyFilter(const std::pmr::vector<int>& filtered_ids, std::pmr::vector<SegmentQuery>& segment_queries) const;
+    std::pmr::vector<ScoringRange> SplitIntoScoringRanges(const std::pmr::vector<SegmentQuery>& segment_queries,
+                                                          ExecutionPath path,
+                                                          std::pmr::memory_resource* resource) const;
+
+    // The page is exact if its last document outscores the sum of the boundaries of the lists
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    bool FindChampionDocuments(const Query& query, DocumentPredicate document_predicate, const TopSelection& selection,
+                               std::vector<Document>& documents, std::pmr::memory_resource* resource) const;
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    std::vector<Document> FindSelectedDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                const TopSelection& selection, QueryBudget* budget) const;
+    template <typename DocumentPredicate, class ExecutionPolicy>
+    void FindSelectedDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                               const TopSelection& selection, QueryBudget* budget, std::vector<Document>& documents) const;
     template <typename DocumentPredicate, class ExecutionPolicy>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const;
+    std::pmr::vector<Document> FindTopDocumentsInSegments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+                                                          const TopSelection& selection, QueryBudget* budget, ExplainTimer& timer,
+                                                          std::pmr::memory_resource* resource) const;
+    // Facets and counters may be nullptr
+    template <typename DocumentPredicate>
+    size_t ScoreDocuments(const SegmentQuery& segment_query, const ScoringRange& range, DocumentPredicate document_predicate,
+                          const TopSelection& selection, QueryBudget* budget, FacetCounts* facets, ExplainCounters* counters,
+                          Document* top_documents, std::pmr::memory_resource* resource) const;
+    template <typename DocumentPredicate>
+    size_t ScoreDocumentsDense(const SegmentQuery& segment_query, const ScoringRange& range, DocumentPredicate document_predicate,
+                               const TopSelection& selection, BudgetMeter& meter, FacetCounts* facets, ExplainCounters* counters,
+                               Document* top_documents, std::pmr::memory_resource* resource) const;
+    // A positive score must mark a match, so no required word and no negative weight
+    bool IsDenseScoringWorthIt(const SegmentQuery& segment_query, const ScoringRange& range) const;
+    // Impact is double to score by term_freq * weight
+    template <typename Impact, typename DocumentPredicate>
+    size_t ScoreSegmentDocuments(const SegmentQuery& segment_query, const ScoringRange& range, DocumentPredicate document_predicate,
+                                 const TopSelection& selection, BudgetMeter& meter, FacetCounts* facets, ExplainCounters* counters,
+                                 Document* top_documents, std::pmr::memory_resource* resource) const;
+
+    ExecutionPath ChooseExecutionPath(const std::pmr::vector<SegmentQuery>& segment_queries) const;
+    bool IsParallelWorthIt(size_t work) const;
+
+    // Called with segments_guard_ held
+    std::vector<char> GetRemovedFlags(int first_internal_id, int last_internal_id) const;
+    size_t FindMergeCandidates() const;
+    void ScheduleMerge();
+    void MergeSegments();
+    void RefreshImpacts();
+    void EnforceMemoryBudget();
+    // order lists the old internal ids of the live documents by their new internal ids
+    void RenumberDocuments(const std::vector<int>& order);
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words) {
-    stop_words_ = MakeUniqueNonEmptyStrings(stop_words);
-    if (std::any_of(stop_words_.begin(), stop_words_.end(), [](const std::string_view& word) {
-        return !IsValidWord(word);
-    })) {
-        throw std::invalid_argument("Invalid stop word!");
+SearchServer::SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* index_resource)
+: own_index_resource_(index_resource == nullptr ? std::make_unique<std::pmr::synchronized_pool_resource>() : nullptr)
+, index_resource_(index_resource == nullptr ? own_index_resource_.get() : index_resource)
+{
+    for (const std::string& word : MakeUniqueNonEmptyStrings(stop_words)) {
+        if (!IsValidWord(word)) {
+            throw std::invalid_argument("Invalid stop word!");
+        }
+        // Stop words are normalized like the documents, "из-за" stays one word
+        for (const std::string& normalized_word : SplitIntoWords(NormalizeText(word))) {
+            stop_words_.emplace(normalized_word);
+        }
     }
 }
 
@@ -110,15 +440,7 @@ template <typename DocumentPredicate, class ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                                                      const std::string_view& raw_query,
                                                      DocumentPredicate document_predicate) const {
-    auto matched_documents = FindAllDocuments(policy, ParseQuery(raw_query), document_predicate);
-    std::sort(matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs) {
-                  return std::abs(lhs.relevance - rhs.relevance) < MIN_RELEVANCE_DIFFERENCE ? lhs.rating > rhs.rating : lhs.relevance > rhs.relevance;
-              });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+    return FindSelectedDocuments(policy, raw_query, document_predicate, TopSelection{}, nullptr);
 }
 
 template <class ExecutionPolicy>
@@ -131,96 +453,701 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                             });
 }
 
+template <typename DocumentPredicate, class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     DocumentPredicate document_predicate,
+                                                     QueryBudget& budget) const {
+    return FindSelectedDocuments(policy, raw_query, document_predicate, TopSelection{}, &budget);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     const DocumentStatus& status,
+                                                     QueryBudget& budget) const {
+    return FindTopDocuments(policy, raw_query,
+                            [&status](int document_id, const DocumentStatus& document_status, int rating) {
+                                return document_status == status;
+                            },
+                            budget);
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     DocumentPredicate document_predicate,
+                                                     FacetCounts& facets) const {
+    facets.Reset();
+    TopSelection selection;
+    selection.facets = &facets;
+    return FindSelectedDocuments(policy, raw_query, document_predicate, selection, nullptr);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     const DocumentStatus& status,
+                                                     FacetCounts& facets) const {
+    return FindTopDocuments(policy, raw_query,
+                            [&status](int document_id, const DocumentStatus& document_status, int rating) {
+                                return document_status == status;
+                            },
+                            facets);
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     DocumentPredicate document_predicate,
+                                                     QueryExplain& explain) const {
+    explain = QueryExplain();
+    TopSelection selection;
+    selection.explain = &explain;
+    return FindSelectedDocuments(policy, raw_query, document_predicate, selection, nullptr);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     const DocumentStatus& status,
+                                                     QueryExplain& explain) const {
+    return FindTopDocuments(policy, raw_query,
+                            [&status](int document_id, const DocumentStatus& document_status, int rating) {
+                                return document_status == status;
+                            },
+                            explain);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
+                                                     const std::string_view& raw_query,
+                                                     const DocumentFilter& filter) const {
+    // Status and rating are checked per document as well, for documents that no index narrowed down
+    TopSelection selection;
+    selection.filter = &filter;
+    return FindSelectedDocuments(policy, raw_query,
+                                 [&filter](int document_id, const DocumentStatus& document_status, int rating) {
+                                     return filter.IsMatch(document_status, rating);
+                                 },
+                                 selection, nullptr);
+}
+
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+std::vector<Document> SearchServer::FindTopDocumentsAfter(const std::string_view& raw_query,
+                                                          const std::optional<Document>& cursor,
+                                                          size_t page_size,
+                                                          DocumentPredicate document_predicate) const {
+    return FindTopDocumentsAfter(std::execution::seq, raw_query, cursor, page_size, document_predicate);
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsAfter(ExecutionPolicy&& policy,
+                                                          const std::string_view& raw_query,
+                                                          const std::optional<Document>& cursor,
+                                                          size_t page_size,
+                                                          DocumentPredicate document_predicate) const {
+    return FindSelectedDocuments(policy, raw_query, document_predicate, TopSelection{cursor.has_value() ? &*cursor : nullptr, page_size}, nullptr);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsAfter(ExecutionPolicy&& policy,
+                                                          const std::string_view& raw_query,
+                                                          const std::optional<Document>& cursor,
+                                                          size_t page_size,
+                                                          const DocumentStatus& status) const {
+    return FindTopDocumentsAfter(policy, raw_query, cursor, page_size,
+                                 [&status](int document_id, const DocumentStatus& document_status, int rating) {
+                                     return document_status == status;
+                                 });
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+std::vector<Document> SearchServer::FindSelectedDocuments(ExecutionPolicy&& policy,
+                                                          const std::string_view& raw_query,
+                                                          DocumentPredicate document_predicate,
+                                                          const TopSelection& selection,
+                                                          QueryBudget* budget) const {
+    std::vector<Document> documents;
+    FindSelectedDocuments(policy, raw_query, document_predicate, selection, budget, documents);
+    return documents;
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+void SearchServer::FindSelectedDocuments(ExecutionPolicy&& policy,
+                                         const std::string_view& raw_query,
+                                         DocumentPredicate document_predicate,
+                                         const TopSelection& selection,
+                                         QueryBudget* budget,
+                                         std::vector<Document>& documents) const {
+    ExplainTimer timer(selection.explain);
+    QueryArena arena;
+    const Query query = ParseQuery(raw_query, &arena);
+    if (selection.explain != nullptr) {
+        ExplainWords(query, *selection.explain);
+    }
+    timer.EndStage(&QueryExplain::parse_time);
+    const bool is_champion_page = FindChampionDocuments(query, document_predicate, selection, documents, &arena);
+    timer.EndStage(&QueryExplain::champion_time);
+    if (is_champion_page) {
+        return;
+    }
+    auto matched_documents = FindTopDocumentsInSegments(policy, query, document_predicate, selection, budget, timer, &arena);
+    const auto top_end = matched_documents.begin() + std::min(matched_documents.size(), selection.count);
+    std::partial_sort(matched_documents.begin(), top_end, matched_documents.end(), IsMoreRelevant);
+    timer.EndStage(&QueryExplain::merge_time);
+    if (selection.explain != nullptr) {
+        selection.explain->result_count = top_end - matched_documents.begin();
+    }
+    documents.assign(matched_documents.begin(), top_end);
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::FindChampionDocuments(const Query& query,
+                                         DocumentPredicate document_predicate,
+                                         const TopSelection& selection,
+                                         std::vector<Document>& documents,
+                                         std::pmr::memory_resource* resource) const {
+    // Quantized impacts would score the same documents differently
+    if (!execution_thresholds_.use_champion_lists || impact_precision_ != ImpactPrecision::NONE
+        || selection.count == 0 || selection.count > CHAMPION_LIST_SIZE
+        || (selection.filter != nullptr && selection.filter->document_ids.has_value()) || selection.facets != nullptr) {
+        return false;
+    }
+
+    struct ChampionTerm {
+        int term_id;
+        double weight;
+        bool is_required;
+    };
+    std::pmr::vector<ChampionTerm> plus_terms(resource);
+    std::pmr::vector<int> candidates(resource);
+    double max_outside_relevance = 0.0;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = GetTermId(query.plus_words[i]);
+        const bool is_required = std::binary_search(query.required_words.begin(), query.required_words.end(), query.plus_words[i]);
+        if (term_id < 0 || document_freqs_[term_id] == 0) {
+            if (is_required) {
+                return false;
+            }
             continue;
         }
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * ComputeWordInverseDocumentFreq(word);
-            }
+        const auto it = champion_lists_.find(term_id);
+        if (it == champion_lists_.end()) {
+            return false;
+        }
+        const ChampionList& list = it->second;
+        const double weight = ComputeInverseDocumentFreq(term_id) * query.plus_weights[i];
+        plus_terms.push_back({term_id, weight, is_required});
+        max_outside_relevance += weight * list.boundary_term_freq;
+        for (const ChampionList::Entry& entry : list.entries) {
+            candidates.push_back(entry.internal_id);
         }
     }
+    if (plus_terms.empty()) {
+        return false;
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
 
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    // Candidates are scored in the order of the plus words, as the segments score them, so the sums are the same
+    TopDocuments top_documents(selection, resource);
+    ExplainCounters counters;
+    for (const int internal_id : candidates) {
+        const DocumentData& document_data = documents_[internal_id];
+        if (document_data.is_removed) {
             continue;
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        const TermFrequency* const first = GetDocumentTermsBegin(internal_id);
+        const TermFrequency* const last = GetDocumentTermsEnd(internal_id);
+        auto find_term = [&](int term_id) {
+            const TermFrequency* entry = std::lower_bound(first, last, term_id, [](const TermFrequency& entry, int term_id) {
+                return entry.term_id < term_id;
+            });
+            return entry != last && entry->term_id == term_id ? entry : nullptr;
+        };
+        bool is_match = true;
+        bool is_minus_match = false;
+        double relevance = 0.0;
+        for (const ChampionTerm& term : plus_terms) {
+            const TermFrequency* entry = find_term(term.term_id);
+            if (entry != nullptr) {
+                relevance += entry->term_freq * term.weight;
+            } else if (term.is_required) {
+                is_match = false;
+                break;
+            }
+        }
+        for (const std::string_view& word : query.minus_words) {
+            const int term_id = GetTermId(word);
+            if (is_match && term_id >= 0 && find_term(term_id) != nullptr) {
+                is_match = false;
+                is_minus_match = true;
+            }
+        }
+        counters.minus_removed_count += is_minus_match ? 1 : 0;
+        if (!is_match) {
+            continue;
+        }
+        ++counters.matched_count;
+        if (document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            top_documents.Add({document_data.id, relevance, document_data.rating});
+        } else {
+            ++counters.predicate_rejected_count;
         }
     }
 
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance.size());
-    for (const auto& [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+    documents.resize(selection.count);
+    const size_t count = top_documents.Extract(documents.data());
+    const bool is_exact = count == selection.count && documents.back().relevance - max_outside_relevance >= MIN_RELEVANCE_DIFFERENCE;
+    // A page that isn't proven exact is scored again from the posting lists, which count on their own
+    if (is_exact && selection.explain != nullptr) {
+        QueryExplain& explain = *selection.explain;
+        explain.is_champion_path = true;
+        explain.result_count = count;
+        counters.scanned_counts.assign(query.plus_words.size(), 0);
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            const int term_id = GetTermId(query.plus_words[i]);
+            const auto it = term_id < 0 ? champion_lists_.end() : champion_lists_.find(term_id);
+            counters.scanned_counts[i] = it == champion_lists_.end() ? 0 : it->second.entries.size();
+            explain.words[i].scanned_count = counters.scanned_counts[i];
+        }
+        explain.counters = std::move(counters);
     }
-    return matched_documents;
+    return is_exact;
+}
+
+template <typename DocumentPredicate>
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(const std::string_view& raw_query,
+                                                                       DocumentPredicate document_predicate,
+                                                                       TaskPriority priority) const {
+    return thread_pool_->Submit([this, query = std::string(raw_query), document_predicate] {
+        return FindTopDocuments(std::execution::par, query, document_predicate);
+    }, priority);
+}
 
+template <typename Function>
+void SearchServer::RunWriteBatch(Function changes) {
+    WriteAheadLog* const write_ahead_log = write_ahead_log_;
+    if (write_ahead_log == nullptr) {
+        changes();
+        return;
+    }
+    write_ahead_log->BeginBatch();
+    try {
+        changes();
+    } catch (...) {
+        write_ahead_log->EndBatch();
+        throw;
+    }
+    write_ahead_log->EndBatch();
 }
 
 template <typename DocumentPredicate, class ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const {
-    if (std::is_same_v<std::decay_t<ExecutionPolicy>, std::decay_t<std::execution::sequenced_policy> >) {
-        return FindAllDocuments(query, document_predicate);
+std::pmr::vector<Document> SearchServer::FindTopDocumentsInSegments(ExecutionPolicy&& policy,
+                                                                   const Query& query,
+                                                                   DocumentPredicate document_predicate,
+                                                                   const TopSelection& selection,
+                                                                   QueryBudget* budget,
+                                                                   ExplainTimer& timer,
+                                                                   std::pmr::memory_resource* resource) const {
+    const std::pmr::vector<std::shared_ptr<const IndexSegment>> segments = GetSegments(resource);
+    std::pmr::vector<SegmentQuery> segment_queries = PrepareSegmentQueries(query, segments, resource);
+    std::pmr::vector<int> filtered_ids(resource);
+    const bool is_filter_indexed = selection.filter != nullptr && IsFilterIndexWorthIt(*selection.filter, segment_queries);
+    if (is_filter_indexed) {
+        filtered_ids = FilterDocuments(*selection.filter, resource);
+        ApplyFilter(filtered_ids, segment_queries);
     }
 
-    ConcurrentMap<int, double> document_to_relevance(NUMBER_THREADS);
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](const std::string_view& word) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
+    using Policy = std::decay_t<ExecutionPolicy>;
+    ExecutionPath path = ExecutionPath::PARALLEL_CHUNKS;
+    if constexpr (std::is_same_v<Policy, std::execution::sequenced_policy>) {
+        path = ExecutionPath::SEQUENTIAL;
+    } else if constexpr (std::is_same_v<Policy, AdaptiveExecutionPolicy>) {
+        path = ChooseExecutionPath(segment_queries);
+    }
+    const std::pmr::vector<ScoringRange> ranges = SplitIntoScoringRanges(segment_queries, path, resource);
+    QueryExplain* const explain = selection.explain;
+    if (explain != nullptr) {
+        explain->path = path;
+        explain->segment_count = segment_queries.size();
+        explain->is_filter_indexed = is_filter_indexed;
+    }
+    timer.EndStage(&QueryExplain::plan_time);
+
+    // Every range writes its top documents to a slot of its own
+    std::pmr::vector<Document> top_documents(ranges.size() * selection.count, resource);
+    std::pmr::vector<size_t> top_counts(ranges.size(), 0, resource);
+    // Facets are counted per range as well, so parallel tasks never share a counter
+    std::pmr::vector<FacetCounts> range_facets(resource);
+    if (selection.facets != nullptr) {
+        range_facets.assign(ranges.size(), FacetCounts(selection.facets->GetRatingBounds()));
+    }
+    std::pmr::vector<ExplainCounters> range_counters(resource);
+    if (explain != nullptr) {
+        range_counters.assign(ranges.size(), ExplainCounters(query.plus_words.size()));
+    }
+    auto score_range = [&](size_t index, std::pmr::memory_resource* range_resource) {
+        const ScoringRange& range = ranges[index];
+        top_counts[index] = ScoreDocuments(segment_queries[range.segment_index], range, document_predicate, selection, budget,
+                                           range_facets.empty() ? nullptr : &range_facets[index],
+                                           range_counters.empty() ? nullptr : &range_counters[index],
+                                           top_documents.data() + index * selection.count, range_resource);
+    };
+    if (path == ExecutionPath::SEQUENTIAL) {
+        for (size_t index = 0; index < ranges.size(); ++index) {
+            score_range(index, resource);
         }
+    } else {
+        thread_pool_->ParallelFor(ranges.size(), [&](size_t index) {
+            QueryArena range_arena;
+            score_range(index, &range_arena);
+        });
+    }
+    timer.EndStage(&QueryExplain::score_time);
+
+    auto last = top_documents.begin();
+    for (size_t index = 0; index < ranges.size(); ++index) {
+        const auto slot = top_documents.begin() + index * selection.count;
+        last = std::copy(slot, slot + top_counts[index], last);
+    }
+    top_documents.erase(last, top_documents.end());
+    for (const FacetCounts& facets : range_facets) {
+        selection.facets->Merge(facets);
+    }
+    if (explain != nullptr) {
+        explain->counters = ExplainCounters(query.plus_words.size());
+        for (const ExplainCounters& counters : range_counters) {
+            explain->counters.Merge(counters);
+        }
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            explain->words[i].scanned_count = explain->counters.scanned_counts[i];
+        }
+    }
+    return top_documents;
+}
 
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id].ref_to_value += term_freq * ComputeWordInverseDocumentFreq(word);
+template <typename DocumentPredicate>
+size_t SearchServer::ScoreDocuments(const SegmentQuery& segment_query,
+                                    const ScoringRange& range,
+                                    DocumentPredicate document_predicate,
+                                    const TopSelection& selection,
+                                    QueryBudget* budget,
+                                    FacetCounts* facets,
+                                    ExplainCounters* counters,
+                                    Document* top_documents,
+                                    std::pmr::memory_resource* resource) const {
+    BudgetMeter meter(budget);
+    // Ranges that start after the budget ran out add nothing
+    if (meter.IsExhausted()) {
+        return 0;
+    }
+    const ImpactPrecision precision = segment_query.impacts == nullptr ? ImpactPrecision::NONE : segment_query.impacts->GetPrecision();
+    if (precision == ImpactPrecision::NONE && IsDenseScoringWorthIt(segment_query, range)) {
+        if (counters != nullptr) {
+            ++counters->dense_range_count;
+        }
+        return ScoreDocumentsDense(segment_query, range, document_predicate, selection, meter, facets, counters, top_documents, resource);
+    }
+    if (counters != nullptr) {
+        ++(segment_query.is_intersection ? counters->intersection_range_count : counters->merge_range_count);
+    }
+    switch (precision) {
+        case ImpactPrecision::BITS_8:
+            return ScoreSegmentDocuments<uint8_t>(segment_query, range, document_predicate, selection, meter, facets, counters,
+                                                  top_documents, resource);
+        case ImpactPrecision::BITS_16:
+            return ScoreSegmentDocuments<uint16_t>(segment_query, range, document_predicate, selection, meter, facets, counters,
+                                                   top_documents, resource);
+        default:
+            return ScoreSegmentDocuments<double>(segment_query, range, document_predicate, selection, meter, facets, counters,
+                                                 top_documents, resource);
+    }
+}
+
+template <typename DocumentPredicate>
+size_t SearchServer::ScoreDocumentsDense(const SegmentQuery& segment_query,
+                                         const ScoringRange& range,
+                                         DocumentPredicate document_predicate,
+                                         const TopSelection& selection,
+                                         BudgetMeter& meter,
+                                         FacetCounts* facets,
+                                         ExplainCounters* counters,
+                                         Document* top_documents,
+                                         std::pmr::memory_resource* resource) const {
+    const int base = range.first_internal_id;
+    const size_t document_count = range.last_internal_id - range.first_internal_id;
+    std::pmr::vector<double> scores(document_count, 0.0, resource);
+    std::pmr::vector<uint32_t> exclusion_mask(GetExclusionMaskSize(document_count), 0, resource);
+    if (segment_query.is_filtered) {
+        // Documents outside the filter are excluded like those with minus words
+        std::fill(exclusion_mask.begin(), exclusion_mask.end(), ~uint32_t{0});
+        RemoveFromExclusionMask(segment_query.filter.internal_ids, segment_query.filter.size, base, document_count, exclusion_mask.data());
+    }
+    // An explained query scores the documents with minus words too, to count those the minus words drop
+    std::pmr::vector<uint32_t> minus_mask(resource);
+    if (counters != nullptr) {
+        minus_mask.assign(exclusion_mask.size(), 0);
+    }
+    for (const PostingList& postings : segment_query.minus_postings) {
+        AddToExclusionMask(postings.internal_ids, postings.size, base, document_count,
+                           counters == nullptr ? exclusion_mask.data() : minus_mask.data());
+    }
+    bool is_within_budget = true;
+    for (const auto& plus_postings : segment_query.plus_postings) {
+        const PostingList& postings = plus_postings.postings;
+        const int* first = std::lower_bound(postings.internal_ids, postings.internal_ids + postings.size, range.first_internal_id);
+        const int* last = std::lower_bound(first, postings.internal_ids + postings.size, range.last_internal_id);
+        const int* const scan_start = first;
+        // The list is accumulated a block at a time, a block never overruns the budget by more than itself
+        while (is_within_budget && first != last) {
+            const size_t block_size = std::min<size_t>(last - first, BUDGET_CHECK_INTERVAL);
+            AccumulateScores(first, postings.term_freqs + (first - postings.internal_ids), block_size, plus_postings.weight,
+                             base, exclusion_mask.data(), scores.data());
+            first += block_size;
+            is_within_budget = meter.Add(block_size);
+        }
+        if (counters != nullptr) {
+            counters->scanned_counts[plus_postings.word_index] += first - scan_start;
+        }
+    }
+
+    TopDocuments matched_documents(selection, resource);
+    for (size_t offset = 0; offset < document_count; ++offset) {
+        if (scores[offset] > 0.0) {
+            const DocumentData& document_data = documents_[base + offset];
+            if (document_data.is_removed) {
+                continue;
+            }
+            if (counters != nullptr) {
+                if ((minus_mask[offset >> 5] >> (offset & 31)) & 1) {
+                    ++counters->minus_removed_count;
+                    continue;
+                }
+                ++counters->matched_count;
+            }
+            const bool is_hit = document_predicate(document_data.id, document_data.status, document_data.rating);
+            if (facets != nullptr) {
+                facets->Add(document_data.status, document_data.rating, is_hit);
+            }
+            if (counters != nullptr && !is_hit) {
+                ++counters->predicate_rejected_count;
+            }
+            if (is_hit) {
+                matched_documents.Add({document_data.id, scores[offset], document_data.rating});
             }
         }
-    });
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view& word) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    }
+    return matched_documents.Extract(top_documents);
+}
+
+template <typename Impact, typename DocumentPredicate>
+size_t SearchServer::ScoreSegmentDocuments(const SegmentQuery& segment_query,
+                                           const ScoringRange& range,
+                                           DocumentPredicate document_predicate,
+                                           const TopSelection& selection,
+                                           BudgetMeter& meter,
+                                           FacetCounts* facets,
+                                           ExplainCounters* counters,
+                                           Document* top_documents,
+                                           std::pmr::memory_resource* resource) const {
+    // Impacts are summed as integers and scaled once per document
+    constexpr bool is_exact = std::is_same_v<Impact, double>;
+    using Score = std::conditional_t<is_exact, double, uint32_t>;
+    const double step = is_exact ? 1.0 : segment_query.impacts->GetStep();
+
+    const auto& plus_postings = segment_query.plus_postings;
+    const auto& minus_postings = segment_query.minus_postings;
+    std::pmr::vector<size_t> plus_positions(plus_postings.size(), 0, resource);
+    for (size_t i = 0; i < plus_postings.size(); ++i) {
+        const PostingList& postings = plus_postings[i].postings;
+        plus_positions[i] = std::lower_bound(postings.internal_ids, postings.internal_ids + postings.size, range.first_internal_id)
+                            - postings.internal_ids;
+    }
+    std::pmr::vector<size_t> minus_positions(minus_postings.size(), 0, resource);
+    // Scanned postings are told by how far the cursors moved
+    std::pmr::vector<size_t> scan_starts(resource);
+    if (counters != nullptr) {
+        scan_starts = plus_positions;
+    }
+
+    auto score = [&plus_postings](size_t i, size_t position) -> Score {
+        if constexpr (is_exact) {
+            return plus_postings[i].postings.term_freqs[position] * plus_postings[i].weight;
+        } else {
+            return static_cast<const Impact*>(plus_postings[i].impacts)[position];
+        }
+    };
+
+    const PostingList& filter = segment_query.filter;
+    size_t filter_position = 0;
+
+    TopDocuments matched_documents(selection, resource);
+    auto add_document = [&](int internal_id, double relevance) {
+        // Documents come in ascending order, so the filter and minus cursors only move forward
+        if (segment_query.is_filtered) {
+            filter_position = SkipTo(filter, filter_position, internal_id);
+            if (filter_position == filter.size || filter.internal_ids[filter_position] != internal_id) {
+                return;
+            }
+        }
+        for (size_t i = 0; i < minus_postings.size(); ++i) {
+            minus_positions[i] = SkipTo(minus_postings[i], minus_positions[i], internal_id);
+            if (minus_positions[i] < minus_postings[i].size && minus_postings[i].internal_ids[minus_positions[i]] == internal_id) {
+                if (counters != nullptr && !documents_[internal_id].is_removed) {
+                    ++counters->minus_removed_count;
+                }
+                return;
+            }
+        }
+        const DocumentData& document_data = documents_[internal_id];
+        if (document_data.is_removed) {
             return;
         }
+        const bool is_hit = document_predicate(document_data.id, document_data.status, document_data.rating);
+        if (facets != nullptr) {
+            facets->Add(document_data.status, document_data.rating, is_hit);
+        }
+        if (counters != nullptr) {
+            ++counters->matched_count;
+            counters->predicate_rejected_count += is_hit ? 0 : 1;
+        }
+        if (is_hit) {
+            matched_documents.Add({document_data.id, relevance, document_data.rating});
+        }
+    };
+
+    if (!segment_query.is_intersection) {
+        while (true) {
+            int internal_id = range.last_internal_id;
+            for (size_t i = 0; i < plus_postings.size(); ++i) {
+                if (plus_positions[i] < plus_postings[i].postings.size) {
+                    internal_id = std::min(internal_id, plus_postings[i].postings.internal_ids[plus_positions[i]]);
+                }
+            }
+            if (internal_id >= range.last_internal_id) {
+                break;
+            }
 
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.Erase(document_id);
+            Score relevance = 0;
+            size_t posting_count = 0;
+            for (size_t i = 0; i < plus_postings.size(); ++i) {
+                const PostingList& postings = plus_postings[i].postings;
+                size_t& position = plus_positions[i];
+                if (position < postings.size && postings.internal_ids[position] == internal_id) {
+                    relevance += score(i, position);
+                    ++position;
+                    ++posting_count;
+                }
+            }
+            add_document(internal_id, relevance * step);
+            if (!meter.Add(posting_count)) {
+                break;
+            }
+        }
+    } else {
+        // The driving lists are the required ones and the filter, from the shortest
+        std::pmr::vector<const PostingList*> driving_postings(resource);
+        for (const size_t index : segment_query.required_order) {
+            driving_postings.push_back(&plus_postings[index].postings);
         }
-    });
+        if (segment_query.is_filtered) {
+            const auto it = std::find_if(driving_postings.begin(), driving_postings.end(), [&filter](const PostingList* postings) {
+                return postings->size > filter.size;
+            });
+            driving_postings.insert(it, &filter);
+        }
+        std::pmr::vector<size_t> driving_positions(driving_postings.size(), 0, resource);
 
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance.GetSize());
-    for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+        // Every driving list in turn skips to the candidate, the first one to overshoot it proposes the next candidate
+        int candidate = range.first_internal_id;
+        bool is_exhausted = false;
+        while (!is_exhausted && candidate < range.last_internal_id) {
+            // Every candidate costs a probe of each driving list
+            if (!meter.Add(driving_postings.size())) {
+                break;
+            }
+            bool is_common = true;
+            for (size_t index = 0; index < driving_postings.size(); ++index) {
+                const PostingList& postings = *driving_postings[index];
+                size_t& position = driving_positions[index];
+                position = SkipTo(postings, position, candidate);
+                if (position == postings.size) {
+                    is_exhausted = true;
+                    is_common = false;
+                    break;
+                }
+                if (postings.internal_ids[position] != candidate) {
+                    candidate = postings.internal_ids[position];
+                    is_common = false;
+                    break;
+                }
+            }
+            if (!is_common) {
+                continue;
+            }
+
+            // Without required words a document of the filter matches only if it has some plus word
+            Score relevance = 0;
+            size_t posting_count = 0;
+            for (size_t i = 0; i < plus_postings.size(); ++i) {
+                const PostingList& postings = plus_postings[i].postings;
+                size_t& position = plus_positions[i];
+                position = SkipTo(postings, position, candidate);
+                if (position < postings.size && postings.internal_ids[position] == candidate) {
+                    relevance += score(i, position);
+                    ++posting_count;
+                }
+            }
+            if (posting_count > 0) {
+                add_document(candidate, relevance * step);
+            }
+            ++candidate;
+        }
     }
-    return matched_documents;
+
+    if (counters != nullptr) {
+        for (size_t i = 0; i < plus_postings.size(); ++i) {
+            counters->scanned_counts[plus_postings[i].word_index] += plus_positions[i] - scan_starts[i];
+        }
+    }
+    return matched_documents.Extract(top_documents);
 }
 
 template<class ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    if (documents_.count(document_id) == 0) {
+    const auto it = internal_ids_.find(document_id);
+    if (it == internal_ids_.end()) {
         return;
     }
-
-    std::vector<std::string_view> words;
-    words.reserve(document_word_freq_.at(document_id).size());
-    for (const auto& [word, _] : document_word_freq_.at(document_id)) {
-        words.push_back(word);
+    if (write_ahead_log_ != nullptr) {
+        write_ahead_log_->LogRemoveDocument(document_id);
     }
 
+    // Postings stay in their segments until the next seal or merge, queries skip them meanwhile
+    const int internal_id = it->second;
+    const TermFrequency* const first = GetDocumentTermsBegin(internal_id);
+    const TermFrequency* const last = GetDocumentTermsEnd(internal_id);
+    auto forget_term = [&](const TermFrequency& entry) {
+        --document_freqs_[entry.term_id];
+    };
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        std::for_each(first, last, forget_term);
+    } else {
+        // Terms of a document are unique, every task updates counters of its own
+        thread_pool_->ParallelFor(last - first, [&](size_t index) {
+            forget_term(first[index]);
+        });
+    }
 
-    std::for_each(std::execution::par, policy, words.begin(), words.end(), [&](const auto it) {
-        word_to_document_freqs_.at(*it).erase(document_id);
-    });
-
-    documents_.erase(document_id);
-    document_word_freq_.erase(document_id);
+    {
+        std::lock_guard guard(segments_guard_);
+        documents_[internal_id].is_removed = true;
+    }
+    RemoveFromChampionLists(internal_id);
+    MarkRatingStale();
+    internal_ids_.erase(it);
     ids_.erase(document_id);
+    ++removed_since_compaction_;
 }
@@ -1,10 +1,192 @@
 #include "string_processing.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Folded ASCII byte: digits, lowercase letters and hyphens as they are, uppercase letters lowercased, the rest turned
+// into spaces. Hyphens outside words are turned into spaces afterwards.
+std::array<char, 128> MakeAsciiFolding() {
+    std::array<char, 128> folding;
+    for (int c = 0; c < 128; ++c) {
+        folding[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' ? static_cast<char>(c)
+                   : c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a')
+                   : ' ';
+    }
+    return folding;
+}
+
+const std::array<char, 128> ASCII_FOLDING = MakeAsciiFolding();
+
+// Marks whitespace and punctuation in TWO_BYTE_FOLDING
+const char16_t SEPARATOR = 0;
+const char16_t FIRST_TWO_BYTE_CODE_POINT = 0x80;
+const char16_t FIRST_THREE_BYTE_CODE_POINT = 0x800;
+
+// Folded code points U+0080..U+07FF, those taking two bytes in UTF-8. Every lowercase
+// counterpart is in the same range, letters folding to one byte (like U+0130) are kept.
+std::array<char16_t, FIRST_THREE_BYTE_CODE_POINT - FIRST_TWO_BYTE_CODE_POINT> MakeTwoByteFolding() {
+    std::array<char16_t, FIRST_THREE_BYTE_CODE_POINT - FIRST_TWO_BYTE_CODE_POINT> folding;
+    auto set = [&folding](char16_t code_point, char16_t folded) {
+        folding[code_point - FIRST_TWO_BYTE_CODE_POINT] = folded;
+    };
+    for (char16_t c = FIRST_TWO_BYTE_CODE_POINT; c < FIRST_THREE_BYTE_CODE_POINT; ++c) {
+        set(c, c);
+    }
+
+    // Latin-1: controls, no-break space, quotes and signs, but the letters ª, µ and º
+    for (char16_t c = 0x80; c < 0xC0; ++c) {
+        if (c != 0xAA && c != 0xB5 && c != 0xBA) {
+            set(c, SEPARATOR);
+        }
+    }
+    set(0xD7, SEPARATOR);
+    set(0xF7, SEPARATOR);
+    for (char16_t c = 0xC0; c <= 0xDE; ++c) {
+        if (c != 0xD7) {
+            set(c, c + 0x20);
+        }
+    }
+    // Latin Extended-A: pairs of an uppercase and a lowercase letter
+    for (char16_t c = 0x100; c < 0x138; c += 2) {
+        if (c != 0x130) {
+            set(c, c + 1);
+        }
+    }
+    for (char16_t c = 0x139; c < 0x148; c += 2) {
+        set(c, c + 1);
+    }
+    for (char16_t c = 0x14A; c < 0x178; c += 2) {
+        set(c, c + 1);
+    }
+    set(0x178, 0xFF);
+    for (char16_t c = 0x179; c < 0x17F; c += 2) {
+        set(c, c + 1);
+    }
+    // Greek
+    set(0x37E, SEPARATOR);
+    set(0x386, 0x3AC);
+    set(0x387, SEPARATOR);
+    for (char16_t c = 0x388; c <= 0x38A; ++c) {
+        set(c, c + 0x25);
+    }
+    set(0x38C, 0x3CC);
+    set(0x38E, 0x3CD);
+    set(0x38F, 0x3CE);
+    for (char16_t c = 0x391; c <= 0x3AB; ++c) {
+        if (c != 0x3A2) {
+            set(c, c + 0x20);
+        }
+    }
+    // Cyrillic
+    for (char16_t c = 0x400; c < 0x410; ++c) {
+        set(c, c + 0x50);
+    }
+    for (char16_t c = 0x410; c < 0x430; ++c) {
+        set(c, c + 0x20);
+    }
+    for (char16_t c = 0x460; c < 0x482; c += 2) {
+        set(c, c + 1);
+    }
+    set(0x482, SEPARATOR);
+    for (char16_t c = 0x48A; c < 0x4C0; c += 2) {
+        set(c, c + 1);
+    }
+    set(0x4C0, 0x4CF);
+    for (char16_t c = 0x4C1; c < 0x4CF; c += 2) {
+        set(c, c + 1);
+    }
+    for (char16_t c = 0x4D0; c < 0x500; c += 2) {
+        set(c, c + 1);
+    }
+    return folding;
+}
+
+const std::array<char16_t, FIRST_THREE_BYTE_CODE_POINT - FIRST_TWO_BYTE_CODE_POINT> TWO_BYTE_FOLDING = MakeTwoByteFolding();
+
+bool IsContinuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// General punctuation, ideographic space and punctuation, byte order mark
+bool IsThreeByteSeparator(uint32_t code_point) {
+    return (code_point >= 0x2000 && code_point < 0x2070)
+        || (code_point >= 0x3000 && code_point < 0x3004)
+        || code_point == 0xFEFF;
+}
+
+// Folds the character starting at position and returns the position after it. Bytes of malformed sequences are kept.
+size_t FoldCharacter(char* text, size_t size, size_t position) {
+    const unsigned char lead = static_cast<unsigned char>(text[position]);
+    if (lead < 0x80) {
+        text[position] = ASCII_FOLDING[lead];
+        return position + 1;
+    }
+    if (lead >= 0xC2 && lead < 0xE0 && position + 1 < size && IsContinuation(text[position + 1])) {
+        const char16_t code_point = static_cast<char16_t>(((lead & 0x1F) << 6) | (text[position + 1] & 0x3F));
+        const char16_t folded = TWO_BYTE_FOLDING[code_point - FIRST_TWO_BYTE_CODE_POINT];
+        if (folded == SEPARATOR) {
+            text[position] = ' ';
+            text[position + 1] = ' ';
+        } else {
+            text[position] = static_cast<char>(0xC0 | (folded >> 6));
+            text[position + 1] = static_cast<char>(0x80 | (folded & 0x3F));
+        }
+        return position + 2;
+    }
+    if (lead >= 0xE0 && lead < 0xF0 && position + 2 < size
+        && IsContinuation(text[position + 1]) && IsContinuation(text[position + 2])) {
+        const uint32_t code_point = ((lead & 0x0F) << 12) | ((text[position + 1] & 0x3F) << 6) | (text[position + 2] & 0x3F);
+        if (IsThreeByteSeparator(code_point)) {
+            std::fill(text + position, text + position + 3, ' ');
+        }
+        return position + 3;
+    }
+    if (lead >= 0xF0 && lead < 0xF5 && position + 3 < size
+        && IsContinuation(text[position + 1]) && IsContinuation(text[position + 2]) && IsContinuation(text[position + 3])) {
+        return position + 4;
+    }
+    return position + 1;
+}
+
+#if defined(__SSE2__)
+// Folds sixteen bytes if all of them are ASCII
+bool FoldAsciiBlock(char* block) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    if (_mm_movemask_epi8(bytes) != 0) {
+        return false;
+    }
+    auto in_range = [&bytes](char first, char last) {
+        return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(static_cast<char>(first - 1))),
+                             _mm_cmplt_epi8(bytes, _mm_set1_epi8(static_cast<char>(last + 1))));
+    };
+    const __m128i is_upper = in_range('A', 'Z');
+    const __m128i is_word = _mm_or_si128(_mm_or_si128(_mm_or_si128(is_upper, in_range('a', 'z')), in_range('0', '9')),
+                                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8('-')));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+    bytes = _mm_or_si128(_mm_and_si128(is_word, bytes), _mm_andnot_si128(is_word, _mm_set1_epi8(' ')));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(block), bytes);
+    return true;
+}
+#endif
+
+} // namespace
 
 
 std::vector<std::string_view> SplitIntoWordsView(const std::string_view& text) {
-    std::vector<std::string_view> result;
+    const std::pmr::vector<std::string_view> words = SplitIntoWordsView(text, std::pmr::get_default_resource());
+    return {words.begin(), words.end()};
+}
+
+std::pmr::vector<std::string_view> SplitIntoWordsView(const std::string_view& text, std::pmr::memory_resource* resource) {
+    std::pmr::vector<std::string_view> result(resource);
     int64_t pos = text.find_first_not_of(" ");
     const int64_t pos_end = text.npos;
     while (pos != pos_end) {
@@ -16,6 +198,49 @@ std::vector<std::string_view> SplitIntoWordsView(const std::string_view& text) {
     return result;
 }
 
+size_t CountCodePoints(std::string_view text) {
+    return std::count_if(text.begin(), text.end(), [](const char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    });
+}
+
+void NormalizeText(char* text, size_t size) {
+    size_t position = 0;
+    while (position < size) {
+#if defined(__SSE2__)
+        const size_t block_size = 16;
+        if (position + block_size <= size) {
+            if (FoldAsciiBlock(text + position)) {
+                position += block_size;
+                continue;
+            }
+            // Characters of a block with non-ASCII bytes go one by one
+            const size_t block_end = position + block_size;
+            while (position < block_end) {
+                position = FoldCharacter(text, size, position);
+            }
+            continue;
+        }
+#endif
+        position = FoldCharacter(text, size, position);
+    }
+
+    // Only a hyphen between two word characters keeps them one word, as in "из-за"
+    char* const end = text + size;
+    for (char* hyphen = static_cast<char*>(std::memchr(text, '-', size)); hyphen != nullptr;
+         hyphen = static_cast<char*>(std::memchr(hyphen + 1, '-', end - hyphen - 1))) {
+        if (hyphen == text || hyphen[-1] == ' ' || hyphen + 1 == end || hyphen[1] == ' ' || hyphen[1] == '-') {
+            *hyphen = ' ';
+        }
+    }
+}
+
+std::string NormalizeText(std::string_view text) {
+    std::string normalized(text);
+    NormalizeText(normalized.data(), normalized.size());
+    return normalized;
+}
+
 std::vector<std::string> SplitIntoWords(const std::string_view& text) {
     std::vector<std::string> words;
     int64_t pos = text.find_first_not_of(" ");
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <string>
 #include <set>
 
@@ -11,6 +12,7 @@
 
 
 std::vector<std::string_view> SplitIntoWordsView(const std::string_view& text);
+std::pmr::vector<std::string_view> SplitIntoWordsView(const std::string_view& text, std::pmr::memory_resource* resource);
 
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
@@ -24,3 +26,12 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
 }
 
 std::vector<std::string> SplitIntoWords(const std::string_view& text);
+
+// Case folding of UTF-8 text, the same for documents, queries and stop words. Latin, Greek and Cyrillic letters
+// are lowercased, whitespace and punctuation but hyphens inside words become spaces, the rest is kept as it is.
+// No character changes its length in bytes, so the text is folded in place and offsets into it stay valid.
+void NormalizeText(char* text, size_t size);
+std::string NormalizeText(std::string_view text);
+
+// Number of UTF-8 code points, continuation bytes are not counted
+size_t CountCodePoints(std::string_view text);
@@ -0,0 +1,200 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Decodes the code point at position and moves past it. A malformed byte stands for itself.
+char32_t DecodeCodePoint(std::string_view text, size_t& position) {
+    const unsigned char lead = text[position];
+    size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+    if (position + length > text.size()) {
+        length = 1;
+    }
+    if (length == 1) {
+        ++position;
+        return lead;
+    }
+    char32_t code_point = lead & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        code_point = (code_point << 6) | (static_cast<unsigned char>(text[position + i]) & 0x3F);
+    }
+    position += length;
+    return code_point;
+}
+
+} // namespace
+
+TermDictionary::TermDictionary(std::pmr::memory_resource* resource)
+: text_blocks_(resource)
+, terms_(resource)
+, slots_(16, -1, resource)
+, sorted_ids_(resource)
+{
+}
+
+int TermDictionary::Insert(std::string_view term) {
+    const size_t slot = FindSlot(term);
+    if (slots_[slot] >= 0) {
+        return slots_[slot];
+    }
+
+    const int term_id = static_cast<int>(terms_.size());
+    terms_.push_back(StoreText(term));
+    slots_[slot] = term_id;
+    // Load factor stays under 3/4
+    if (terms_.size() * 4 >= slots_.size() * 3) {
+        Rehash();
+    }
+    if (terms_.size() - sorted_ids_.size() >= std::max(MIN_UNSORTED_TERM_COUNT, sorted_ids_.size() / 8)) {
+        MergeUnsorted();
+    }
+    return term_id;
+}
+
+int TermDictionary::Find(std::string_view term) const {
+    return slots_[FindSlot(term)];
+}
+
+std::string_view TermDictionary::GetTerm(int term_id) const {
+    return terms_[term_id];
+}
+
+const std::string_view* TermDictionary::GetTerms() const {
+    return terms_.data();
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return terms_.size();
+}
+
+std::string_view TermDictionary::StoreText(std::string_view term) {
+    if (text_blocks_.empty() || text_blocks_.back().capacity() - text_blocks_.back().size() < term.size()) {
+        // A block never grows past its capacity, so the text never moves
+        text_blocks_.emplace_back().reserve(std::max(TERM_TEXT_BLOCK_SIZE, term.size()));
+    }
+    std::pmr::vector<char>& block = text_blocks_.back();
+    const size_t offset = block.size();
+    block.insert(block.end(), term.begin(), term.end());
+    return {block.data() + offset, term.size()};
+}
+
+size_t TermDictionary::FindSlot(std::string_view term) const {
+    const size_t mask = slots_.size() - 1;
+    size_t slot = std::hash<std::string_view>{}(term) & mask;
+    while (slots_[slot] >= 0 && terms_[slots_[slot]] != term) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void TermDictionary::Rehash() {
+    std::pmr::vector<int> slots(slots_.size() * 2, -1, slots_.get_allocator().resource());
+    const size_t mask = slots.size() - 1;
+    for (int term_id = 0; term_id < static_cast<int>(terms_.size()); ++term_id) {
+        size_t slot = std::hash<std::string_view>{}(terms_[term_id]) & mask;
+        while (slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = term_id;
+    }
+    slots_.swap(slots);
+}
+
+std::pmr::vector<TermDictionary::TermMatch> TermDictionary::FindWithinDistance(std::string_view term,
+                                                                             int max_distance,
+                                                                             std::pmr::memory_resource* resource) const {
+    std::pmr::vector<char32_t> pattern(resource);
+    for (size_t position = 0; position < term.size();) {
+        pattern.push_back(DecodeCodePoint(term, position));
+    }
+    const size_t width = pattern.size() + 1;
+
+    // Row d holds the distances between the first d code points of the current term and every prefix of the pattern.
+    // offsets[d] is the byte offset in the current term where row d ends.
+    std::pmr::vector<int> rows(resource);
+    for (size_t j = 0; j < width; ++j) {
+        rows.push_back(static_cast<int>(j));
+    }
+    std::pmr::vector<size_t> offsets(1, 0, resource);
+    std::string_view previous;
+
+    // Returns the distance to the text, or max_distance + 1 once a prefix of it gets too far,
+    // in which case is_pruned is set and offsets.back() is the length of that prefix
+    bool is_pruned = false;
+    auto extend = [&](std::string_view text) {
+        is_pruned = false;
+        const size_t common = std::mismatch(previous.begin(), previous.end(), text.begin(), text.end()).first - previous.begin();
+        const size_t depth = std::upper_bound(offsets.begin(), offsets.end(), common) - offsets.begin() - 1;
+        offsets.resize(depth + 1);
+        rows.resize((depth + 1) * width);
+        previous = text;
+
+        for (size_t position = offsets.back(); position < text.size();) {
+            const char32_t code_point = DecodeCodePoint(text, position);
+            const size_t last_row = rows.size() - width;
+            rows.push_back(rows[last_row] + 1);
+            int row_min = rows.back();
+            for (size_t j = 1; j < width; ++j) {
+                const int distance = std::min({rows[last_row + j] + 1,
+                                               rows[last_row + width + j - 1] + 1,
+                                               rows[last_row + j - 1] + (pattern[j - 1] == code_point ? 0 : 1)});
+                rows.push_back(distance);
+                row_min = std::min(row_min, distance);
+            }
+            offsets.push_back(position);
+            if (row_min > max_distance) {
+                is_pruned = true;
+                return max_distance + 1;
+            }
+        }
+        return rows.back();
+    };
+
+    std::pmr::vector<TermMatch> matches(resource);
+    size_t index = 0;
+    while (index < sorted_ids_.size()) {
+        const int term_id = sorted_ids_[index];
+        const int distance = extend(terms_[term_id]);
+        if (distance <= max_distance) {
+            matches.push_back({term_id, distance});
+        }
+        if (is_pruned) {
+            // No term under this prefix can get within the distance. Such subtrees are mostly small, so gallop over them.
+            const std::string_view prefix = terms_[term_id].substr(0, offsets.back());
+            auto has_prefix = [&](int id) {
+                return terms_[id].substr(0, prefix.size()) == prefix;
+            };
+            size_t step = 1;
+            while (index + step < sorted_ids_.size() && has_prefix(sorted_ids_[index + step])) {
+                index += step;
+                step *= 2;
+            }
+            index = std::partition_point(sorted_ids_.begin() + index + 1,
+                                         sorted_ids_.begin() + std::min(index + step, sorted_ids_.size()),
+                                         has_prefix) - sorted_ids_.begin();
+        } else {
+            ++index;
+        }
+    }
+    for (int term_id = static_cast<int>(sorted_ids_.size()); term_id < static_cast<int>(terms_.size()); ++term_id) {
+        const int distance = extend(terms_[term_id]);
+        if (distance <= max_distance) {
+            matches.push_back({term_id, distance});
+        }
+    }
+    return matches;
+}
+
+void TermDictionary::MergeUnsorted() {
+    auto by_text = [this](int lhs, int rhs) {
+        return terms_[lhs] < terms_[rhs];
+    };
+    const size_t sorted_count = sorted_ids_.size();
+    for (int term_id = static_cast<int>(sorted_count); term_id < static_cast<int>(terms_.size()); ++term_id) {
+        sorted_ids_.push_back(term_id);
+    }
+    std::sort(sorted_ids_.begin() + sorted_count, sorted_ids_.end(), by_text);
+    std::inplace_merge(sorted_ids_.begin(), sorted_ids_.begin() + sorted_count, sorted_ids_.end(), by_text);
+}
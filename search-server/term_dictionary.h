@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+const size_t TERM_TEXT_BLOCK_SIZE = 16 * 1024;
+// Terms added since the last merge stay unsorted until there are this many of them or an eighth of the sorted ones
+const size_t MIN_UNSORTED_TERM_COUNT = 256;
+
+// Term ids follow the order of insertion. Text lies in append-only blocks, so the string_views stay valid.
+class TermDictionary {
+public:
+    struct TermMatch {
+        int term_id;
+        int distance;
+    };
+
+    explicit TermDictionary(std::pmr::memory_resource* resource);
+
+    int Insert(std::string_view term);
+    // Returns -1 if there is no such term
+    int Find(std::string_view term) const;
+
+    std::string_view GetTerm(int term_id) const;
+    const std::string_view* GetTerms() const;
+    size_t GetTermCount() const;
+
+    // Calls action(term_id) until it returns false
+    template <typename Action>
+    void ForEachWithPrefix(std::string_view prefix, Action action) const;
+
+    // Levenshtein distance over UTF-8 code points
+    std::pmr::vector<TermMatch> FindWithinDistance(std::string_view term, int max_distance, std::pmr::memory_resource* resource) const;
+
+private:
+    std::pmr::vector<std::pmr::vector<char>> text_blocks_;
+    std::pmr::vector<std::string_view> terms_;
+    // Open addressing, -1 for empty slots
+    std::pmr::vector<int> slots_;
+    // Ids of the first sorted_ids_.size() terms sorted by text
+    std::pmr::vector<int> sorted_ids_;
+
+    std::string_view StoreText(std::string_view term);
+    size_t FindSlot(std::string_view term) const;
+    void Rehash();
+    void MergeUnsorted();
+};
+
+template <typename Action>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Action action) const {
+    auto has_prefix = [this, prefix](int term_id) {
+        return terms_[term_id].substr(0, prefix.size()) == prefix;
+    };
+    auto first = std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), prefix, [this](int term_id, std::string_view prefix) {
+        return terms_[term_id] < prefix;
+    });
+    for (; first != sorted_ids_.end() && has_prefix(*first); ++first) {
+        if (!action(*first)) {
+            return;
+        }
+    }
+    for (int term_id = static_cast<int>(sorted_ids_.size()); term_id < static_cast<int>(terms_.size()); ++term_id) {
+        if (has_prefix(term_id) && !action(term_id)) {
+            return;
+        }
+    }
+}
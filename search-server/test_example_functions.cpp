@@ -1,8 +1,45 @@
 #include "test_example_functions.h"
 #include "search_server.h"
+#include "process_queries.h"
+#include "thread_pool.h"
+#include "memory_resources.h"
+#include "corpus_loader.h"
+#include "write_ahead_log.h"
+#include "term_dictionary.h"
+#include "score_kernels.h"
+#include "paginator.h"
+#include "query_budget.h"
+#include "facet_counts.h"
+#include "query_explain.h"
+#include "query_server.h"
+#include "load_client.h"
+#include "query_replay.h"
+#include "request_queue.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <list>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
 
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
                 const string& hint) {
     if (!value) {
@@ -16,6 +53,46 @@ void AssertImpl(bool value, const string& expr_str, const string& file, const st
     }
 }
 
+set<int> GetIdSet(const vector<Document>& documents) {
+    set<int> ids;
+    for (const Document& document : documents) {
+        ids.insert(document.id);
+    }
+    return ids;
+}
+
+// In the order of the documents
+vector<int> GetIds(const vector<Document>& documents) {
+    vector<int> ids;
+    for (const Document& document : documents) {
+        ids.push_back(document.id);
+    }
+    return ids;
+}
+
+void AssertSameDocuments(const vector<Document>& documents, const vector<Document>& expected_documents, const string& hint) {
+    ASSERT_EQUAL_HINT(documents.size(), expected_documents.size(), hint);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ASSERT_EQUAL_HINT(documents[i].id, expected_documents[i].id, hint);
+        ASSERT_HINT(abs(documents[i].relevance - expected_documents[i].relevance) < 1e-9, hint);
+    }
+}
+
+// counts[i] copies of the i-th of the words below, then filler_count copies of "w<filler>"
+string MakeTestText(const vector<int>& counts, int filler, int filler_count = 1) {
+    static const vector<string> words = {"кот"s, "пёс"s, "хвост"s, "ошейник"s, "попугай"s, "белый"s};
+    string text;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        for (int count = 0; count < counts[i]; ++count) {
+            text += words[i] + " "s;
+        }
+    }
+    for (int count = 0; count < filler_count; ++count) {
+        text += (count == 0 ? "w"s : " w"s) + to_string(filler);
+    }
+    return text;
+}
+
 void TestAddDocument() {
     SearchServer search_server("и в на"s);
 
@@ -162,6 +239,299 @@ void TestMatching() {
     ASSERT(get<0>(match_3).empty());
 }
 
+void TestMatchDocuments() {
+    SearchServer search_server("и в на с"s);
+    search_server.AddDocument(0, "непонятное животное в коробке с апельсинами"s, DocumentStatus::ACTUAL, {8, 8});
+    search_server.AddDocument(1, "черная собака пушистый хвост белый ошейник"s, DocumentStatus::IRRELEVANT, {8, 8});
+    search_server.AddDocument(2, "белый кот и модный ошейник"s, DocumentStatus::BANNED, {8, 8});
+
+    const string query = "белый ошейник животное -кот"s;
+    const vector<int> ids = {0, 1, 2};
+    const auto matches = search_server.MatchDocuments(query, ids);
+    ASSERT_EQUAL(matches.size(), ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        ASSERT(matches[i] == search_server.MatchDocument(query, ids[i]));
+    }
+    ASSERT_EQUAL(get<0>(matches[0]), vector<string_view>({"животное"sv}));
+    ASSERT_EQUAL(get<0>(matches[1]), vector<string_view>({"белый"sv, "ошейник"sv}));
+    ASSERT(get<0>(matches[2]).empty());
+    ASSERT(get<1>(matches[2]) == DocumentStatus::BANNED);
+
+    const auto matches_par = search_server.MatchDocuments(execution::par, query, ids);
+    ASSERT(matches_par == matches);
+}
+
+void TestWordFrequencies() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(0, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+
+    map<string_view, double> freqs_0;
+    for (const auto& [word, freq] : search_server.GetWordFrequencies(0)) {
+        freqs_0[word] = freq;
+    }
+    const map<string_view, double> answer_0 = {{"кот"sv, 0.25}, {"пушистый"sv, 0.5}, {"хвост"sv, 0.25}};
+    ASSERT_EQUAL(freqs_0, answer_0);
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 4u);
+    ASSERT(search_server.GetWordFrequencies(2).empty());
+
+    search_server.RemoveDocument(0);
+    ASSERT(search_server.GetWordFrequencies(0).empty());
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 1);
+    ASSERT(search_server.FindTopDocuments("пушистый"s).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("кот"s).size(), 1u);
+
+    search_server.RemoveDocument(execution::par, 1);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 0);
+    ASSERT(search_server.FindTopDocuments("кот"s).empty());
+}
+
+void TestRequiredWords() {
+    SearchServer search_server("и в на с"s);
+    search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, 8});
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "черная собака пушистый хвост белый ошейник"s, DocumentStatus::ACTUAL, {5});
+
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("+кот пушистый"s)), set<int>({0, 1}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("+пушистый +хвост"s)), set<int>({1, 2}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("+пушистый +хвост -кот"s)), set<int>({2}));
+    ASSERT(search_server.FindTopDocuments("+жираф кот"s).empty());
+    // Required words add to relevance like any plus word
+    ASSERT(abs(search_server.FindTopDocuments("+кот +хвост"s)[0].relevance - search_server.FindTopDocuments("кот хвост"s)[0].relevance) < 1e-9);
+
+    ASSERT(get<0>(search_server.MatchDocument("+кот пушистый"s, 2)).empty());
+    ASSERT(get<0>(search_server.MatchDocument("+кот пушистый"s, 1)) == vector<string_view>({"кот"sv, "пушистый"sv}));
+    ASSERT(get<0>(search_server.MatchDocument("+жираф кот"s, 1)).empty());
+    for (const string& query : {"+"s, "+-кот"s, "-+кот"s, "++кот"s}) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, query);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    // Long sealed lists are intersected through their skip entries, only common documents reach the predicate
+    SearchServer large_server("и"s);
+    const int document_count = 3000;
+    for (int id = 0; id < document_count; ++id) {
+        string text = "x"s;
+        text += id % 3 == 0 ? " a"s : ""s;
+        text += id % 5 == 0 ? " b"s : ""s;
+        text += id % 2 == 0 ? " c"s : ""s;
+        large_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+    for (int step = 0; step < 2; ++step) {
+        for (const auto& [query, expected] : vector<pair<string, int>>{{"+a +b c"s, document_count / 15},
+                                                                       {"+a +b -c"s, document_count / 30},
+                                                                       {"+c +b +a"s, document_count / 30}}) {
+            atomic<int> candidate_count = 0;
+            const auto count_candidates = [&candidate_count](int, DocumentStatus, int) {
+                ++candidate_count;
+                return false;
+            };
+            large_server.FindTopDocuments(query, count_candidates);
+            ASSERT_EQUAL_HINT(candidate_count.load(), expected, query);
+            candidate_count = 0;
+            large_server.FindTopDocuments(execution::par, query, count_candidates);
+            ASSERT_EQUAL_HINT(candidate_count.load(), expected, query);
+        }
+        large_server.Compact();
+    }
+}
+
+void TestPrefixWords() {
+    SearchServer search_server("и в на с"s);
+    search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, 8});
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "черная собака пушок белый ошейник"s, DocumentStatus::ACTUAL, {5});
+
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("пуш*"s)), set<int>({1, 2}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("ко* -бел*"s)), set<int>({1}));
+    ASSERT(search_server.FindTopDocuments("жир*"s).empty());
+    // Expansions are scored as ordinary plus words
+    ASSERT(abs(search_server.FindTopDocuments("пуш*"s)[0].relevance - search_server.FindTopDocuments("пушистый пушок"s)[0].relevance) < 1e-9);
+    ASSERT(get<0>(search_server.MatchDocument("пуш* хво*"s, 1)) == vector<string_view>({"пушистый"sv, "хвост"sv}));
+    for (const string& query : {"*"s, "-*"s, "+пуш*"s}) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, query);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    search_server.RemoveDocument(1);
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("пуш*"s)), set<int>({2}));
+
+    for (int id = 10; id < 110; ++id) {
+        search_server.AddDocument(id, "w"s + to_string(id), DocumentStatus::ACTUAL, {1});
+    }
+    int candidate_count = 0;
+    search_server.FindTopDocuments("w*"s, [&candidate_count](int, DocumentStatus, int) {
+        ++candidate_count;
+        return true;
+    });
+    ASSERT_EQUAL(candidate_count, MAX_PREFIX_EXPANSION_COUNT);
+}
+
+void TestTermDictionary() {
+    CountingResource dictionary_resource;
+    CountingResource map_resource;
+    {
+        TermDictionary dictionary(&dictionary_resource);
+        pmr::map<pmr::string, int, less<>> words(&map_resource);
+        pmr::vector<string_view> term_words(&map_resource);
+
+        const vector<string> roots = {"кот"s, "пёс"s, "попугай"s, "хомяк"s, "черепаха"s};
+        for (int i = 0; i < 5000; ++i) {
+            const string term = roots[i % roots.size()] + to_string(i / roots.size());
+            ASSERT_EQUAL(dictionary.Insert(term), i);
+            const auto it = words.emplace(term, i).first;
+            term_words.push_back(it->first);
+        }
+        ASSERT_EQUAL(dictionary.Insert("кот0"s), 0);
+        ASSERT_EQUAL(dictionary.Find("пёс1"s), 6);
+        ASSERT_EQUAL(dictionary.Find("пёс"s), -1);
+        ASSERT_EQUAL(dictionary.GetTerm(6), "пёс1"sv);
+        ASSERT_EQUAL(dictionary.GetTermCount(), 5000u);
+        ASSERT(dictionary_resource.GetBytesInUse() < map_resource.GetBytesInUse());
+
+        // Terms come both from the sorted run and from the ones added after it
+        dictionary.Insert("хомяк"s);
+        vector<string_view> expansions;
+        dictionary.ForEachWithPrefix("хомяк99"s, [&](int term_id) {
+            expansions.push_back(dictionary.GetTerm(term_id));
+            return true;
+        });
+        ASSERT(expansions == vector<string_view>({"хомяк99"sv, "хомяк990"sv, "хомяк991"sv, "хомяк992"sv, "хомяк993"sv,
+                                                  "хомяк994"sv, "хомяк995"sv, "хомяк996"sv, "хомяк997"sv, "хомяк998"sv, "хомяк999"sv}));
+        int visited = 0;
+        dictionary.ForEachWithPrefix("хомяк"s, [&](int) {
+            return ++visited < 3;
+        });
+        ASSERT_EQUAL(visited, 3);
+        expansions.clear();
+        dictionary.ForEachWithPrefix("хомяк"s, [&](int term_id) {
+            expansions.push_back(dictionary.GetTerm(term_id));
+            return true;
+        });
+        ASSERT_EQUAL(expansions.size(), 1001u);
+    }
+    ASSERT_EQUAL(dictionary_resource.GetBytesInUse(), 0u);
+}
+
+void TestFuzzyWords() {
+    {
+        TermDictionary dictionary(pmr::get_default_resource());
+        for (const string& word : {"кот"s, "кит"s, "коты"s, "крот"s, "скот"s, "пёс"s, "котёнок"s}) {
+            dictionary.Insert(word);
+        }
+        const auto find = [&dictionary](string_view word, int max_distance) {
+            map<string_view, int> result;
+            for (const auto& match : dictionary.FindWithinDistance(word, max_distance, pmr::get_default_resource())) {
+                result[dictionary.GetTerm(match.term_id)] = match.distance;
+            }
+            return result;
+        };
+        // Distances are counted in code points, not in bytes
+        ASSERT((find("кот"s, 1) == map<string_view, int>{{"кот"sv, 0}, {"кит"sv, 1}, {"коты"sv, 1}, {"крот"sv, 1}, {"скот"sv, 1}}));
+        ASSERT((find("кот"s, 0) == map<string_view, int>{{"кот"sv, 0}}));
+        ASSERT_EQUAL(find("котенок"s, 1).count("котёнок"sv), 1u);
+        ASSERT(find("собака"s, 2).empty());
+    }
+
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8});
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7});
+    search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {5});
+
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("пушыстый~"s)), set<int>({1}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("кит~1 -модній~"s)), set<int>({1}));
+    // Short words take no typos unless the distance is given
+    ASSERT(search_server.FindTopDocuments("ко~"s).empty());
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("ко~1"s)), set<int>({0, 1}));
+    ASSERT(get<0>(search_server.MatchDocument("пушыстый~ хвост"s, 1)) == vector<string_view>({"пушистый"sv, "хвост"sv}));
+    // A word found with typos weighs less than the exact one
+    ASSERT(search_server.FindTopDocuments("пушыстый~"s)[0].relevance < search_server.FindTopDocuments("пушистый"s)[0].relevance);
+    ASSERT(abs(search_server.FindTopDocuments("пушистый~"s)[0].relevance - search_server.FindTopDocuments("пушистый"s)[0].relevance) < 1e-9);
+    // A short word takes fewer edits than it has letters, so no expansion weighs zero or less
+    SearchServer short_words_server(""s);
+    short_words_server.AddDocument(0, "ёж"s, DocumentStatus::ACTUAL, {1});
+    short_words_server.AddDocument(1, "уж"s, DocumentStatus::ACTUAL, {1});
+    short_words_server.AddDocument(2, "ты я"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(GetIdSet(short_words_server.FindTopDocuments("ёж~2"s)), set<int>({0, 1}));
+    ASSERT_EQUAL(GetIdSet(short_words_server.FindTopDocuments("я~2"s)), set<int>({2}));
+    for (const Document& document : short_words_server.FindTopDocuments("ёж~2 я~2"s)) {
+        ASSERT_HINT(document.relevance > 0.0, "Fuzzy words of short words weigh more than zero"s);
+    }
+    for (const string& query : {"~"s, "-~1"s, "+кот~"s, "кот*~"s, "кот~3"s}) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, query);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+void TestTextNormalization() {
+    // Every character keeps its length in bytes
+    ASSERT_EQUAL(NormalizeText("Кот, ПЁС и Ёжик — «Друзья»!"s), "кот  пёс и ёжик       друзья   "s);
+    ASSERT_EQUAL(NormalizeText("ÀÉÎ Straße Ωμέγα Їжак Ѣ"s), "àéî straße ωμέγα їжак ѣ"s);
+    ASSERT_EQUAL(NormalizeText("№ 42\xC2\xA0км"s), "№ 42  км"s);
+    ASSERT_EQUAL(NormalizeText("\xD0"s), "\xD0"s);
+    ASSERT_EQUAL(NormalizeText("Из-за -кот- а--б -"s), "из-за  кот  а  б  "s);
+
+    // Long ASCII runs go through the vectorized path and give the same as the byte-wise one
+    mt19937 generator(5);
+    string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += i % 97 == 0 ? "Ё"s : string(1, static_cast<char>(' ' + generator() % 95));
+    }
+    string expected = text;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const unsigned char c = expected[i];
+        if (c >= 0x80) {
+            expected[i] = static_cast<char>(0xD1);
+            expected[i + 1] = static_cast<char>(0x91);
+            ++i;
+        } else if (isupper(c)) {
+            expected[i] = static_cast<char>(tolower(c));
+        } else if (c == '-') {
+            const bool is_inside = i > 0 && expected[i - 1] != ' ' && i + 1 < expected.size()
+                                   && (isalnum(static_cast<unsigned char>(expected[i + 1])) || static_cast<unsigned char>(expected[i + 1]) >= 0x80);
+            expected[i] = is_inside ? '-' : ' ';
+        } else if (!islower(c) && !isdigit(c)) {
+            expected[i] = ' ';
+        }
+    }
+    ASSERT_EQUAL(NormalizeText(text), expected);
+
+    SearchServer search_server("И в НА"s);
+    search_server.AddDocument(0, "Пушистый КОТ, пушистый хвост."s, DocumentStatus::ACTUAL, {7});
+    search_server.AddDocument(1, "иван-чай и мёд"s, DocumentStatus::ACTUAL, {5});
+    search_server.AddDocument(2, "кот"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("Кот"s)), set<int>({0, 2}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("КОТ -Хвост!"s)), set<int>({2}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("ПУШ* Иван-Чай"s)), set<int>({0, 1}));
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("+Иван-Чай"s)), set<int>({1}));
+
+    // A hyphenated stop word stops only itself, not its parts
+    SearchServer hyphen_server("из-за"s);
+    hyphen_server.AddDocument(0, "кот из-за угла"s, DocumentStatus::ACTUAL, {1});
+    hyphen_server.AddDocument(1, "кот за дверью"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(hyphen_server.GetWordFrequencies(0).size(), 2u);
+    ASSERT_EQUAL(GetIdSet(hyphen_server.FindTopDocuments("за"s)), set<int>({1}));
+    ASSERT(hyphen_server.FindTopDocuments("Из-за"s).empty());
+    ASSERT(search_server.FindTopDocuments("И, на"s).empty());
+    ASSERT(get<0>(search_server.MatchDocument("Хвост, КОТ!"s, 0)) == vector<string_view>({"кот"sv, "хвост"sv}));
+    // Only "кот", "пушистый" and "хвост" of the first document
+    ASSERT_EQUAL(search_server.GetWordFrequencies(0).size(), 3u);
+    try {
+        search_server.FindTopDocuments("!!*"s);
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
 void TestSortRelevance() {
     SearchServer search_server("и в на"s);
 
@@ -255,6 +625,357 @@ void TestFilter() {
     ASSERT_EQUAL(id_4, answer_4);
 }
 
+void TestDocumentFilter() {
+    SearchServer search_server("и в на"s);
+    mt19937 generator(45);
+    auto make_text = [&](int word_count) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            // Low words are frequent, so some queries are long and some are short
+            const int word = static_cast<int>(generator() % 40) * static_cast<int>(generator() % 40) / 8;
+            text += "w"s + to_string(word) + " "s;
+        }
+        return text + (generator() % 3 == 0 ? "кот"s : "пёс"s);
+    };
+    for (int id = 0; id < 6000; ++id) {
+        search_server.AddDocument(id, make_text(8), id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 21 - 10});
+    }
+
+    DocumentFilter narrow_filter;
+    narrow_filter.min_rating = 7;
+    narrow_filter.max_rating = 7;
+    DocumentFilter broad_filter;
+    broad_filter.status = nullopt;
+    broad_filter.min_rating = -9;
+    DocumentFilter id_filter;
+    id_filter.document_ids = vector<int>{};
+    for (int id = 3; id < 6000; id += 97) {
+        id_filter.document_ids->push_back(id);
+    }
+    id_filter.document_ids->push_back(100000);
+    DocumentFilter combined_filter = id_filter;
+    combined_filter.status = DocumentStatus::BANNED;
+    combined_filter.min_rating = -5;
+    combined_filter.max_rating = 5;
+    const vector<DocumentFilter> filters = {narrow_filter, broad_filter, id_filter, combined_filter, DocumentFilter{}};
+
+    // Every filter finds what the equivalent predicate finds
+    const vector<string> queries = {"w0 w1"s, "w3 -w0"s, "+w2 w30"s, "кот"s, "w7 w8 w9 -w10"s, "w150 w151"s};
+    auto check_queries = [&] {
+        for (const DocumentFilter& filter : filters) {
+            auto predicate = [&filter](int id, DocumentStatus status, int rating) {
+                return filter.IsMatch(status, rating)
+                       && (!filter.document_ids.has_value() || count(filter.document_ids->begin(), filter.document_ids->end(), id) > 0);
+            };
+            for (const string& query : queries) {
+                const vector<vector<Document>> pages = {
+                    search_server.FindTopDocuments(query, filter),
+                    search_server.FindTopDocuments(execution::par, query, filter),
+                    search_server.FindTopDocuments(adaptive_execution, query, filter),
+                };
+                const vector<Document> expected_page = search_server.FindTopDocuments(query, predicate);
+                for (const vector<Document>& page : pages) {
+                    AssertSameDocuments(page, expected_page, query);
+                }
+            }
+        }
+    };
+    check_queries();
+
+    // The rating index follows re-rated, rewritten and removed documents
+    for (int id = 0; id < 6000; id += 7) {
+        search_server.UpdateDocumentAttributes(id, DocumentStatus::ACTUAL, {7});
+    }
+    for (int id = 1; id < 6000; id += 11) {
+        search_server.UpdateDocument(id, make_text(6));
+    }
+    for (int id = 2; id < 6000; id += 13) {
+        search_server.RemoveDocument(id);
+    }
+    check_queries();
+    const vector<Document> narrow_page = search_server.FindTopDocuments("w0 w1"s, narrow_filter);
+    ASSERT(!narrow_page.empty());
+    for (const Document& document : narrow_page) {
+        ASSERT_EQUAL(document.rating, 7);
+    }
+
+    search_server.ReorderDocuments();
+    check_queries();
+    ASSERT(search_server.FindTopDocuments("w0"s, DocumentFilter{DocumentStatus::ACTUAL, 1, 0, nullopt}).empty());
+}
+
+void TestFacetCounts() {
+    SearchServer search_server("и в на"s);
+    mt19937 generator(46);
+    vector<int> ratings;
+    for (int id = 0; id < 6000; ++id) {
+        string text;
+        for (int i = 0; i < 6; ++i) {
+            text += "w"s + to_string(generator() % 30 * (generator() % 30) / 4) + " "s;
+        }
+        const DocumentStatus status = static_cast<DocumentStatus>(id % 7 % DOCUMENT_STATUS_COUNT);
+        ratings.push_back(id % 21 - 10);
+        search_server.AddDocument(id, text, status, {ratings.back()});
+    }
+    for (int id = 0; id < 6000; id += 17) {
+        search_server.RemoveDocument(id);
+    }
+
+    // Counts of every match against those from MatchDocument
+    const vector<string> queries = {"w0"s, "w1 w2 w3"s, "w4 -w0"s, "+w5 w6"s, "w100 w101"s};
+    for (const string& query : queries) {
+        FacetCounts expected_facets({-5, 0, 5});
+        for (const int document_id : search_server) {
+            const auto [words, status] = search_server.MatchDocument(query, document_id);
+            if (!words.empty()) {
+                expected_facets.Add(status, ratings[document_id], status == DocumentStatus::ACTUAL);
+            }
+        }
+        FacetCounts facets({-5, 0, 5});
+        const vector<Document> documents = search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, facets);
+        const vector<Document> expected_documents = search_server.FindTopDocuments(query);
+        ASSERT_EQUAL_HINT(documents.size(), expected_documents.size(), query);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQUAL_HINT(documents[i].id, expected_documents[i].id, query);
+        }
+        FacetCounts parallel_facets({-5, 0, 5});
+        search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, parallel_facets);
+        FacetCounts adaptive_facets({-5, 0, 5});
+        search_server.FindTopDocuments(adaptive_execution, query, [](int, DocumentStatus status, int) {
+            return status == DocumentStatus::ACTUAL;
+        }, adaptive_facets);
+
+        for (const FacetCounts* counts : {&facets, &parallel_facets, &adaptive_facets}) {
+            ASSERT_EQUAL_HINT(counts->GetHitCount(), expected_facets.GetHitCount(), query);
+            ASSERT_EQUAL_HINT(counts->GetMatchCount(), expected_facets.GetMatchCount(), query);
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+                ASSERT_EQUAL_HINT(counts->GetStatusCount(status), expected_facets.GetStatusCount(status), query);
+            }
+            ASSERT_HINT(counts->GetRatingCounts() == expected_facets.GetRatingCounts(), query);
+        }
+    }
+
+    // Counts are reset by every query, ratings below the first bound aren't counted
+    FacetCounts facets({0});
+    search_server.FindTopDocuments(execution::seq, "w0"s, DocumentStatus::ACTUAL, facets);
+    search_server.FindTopDocuments(execution::seq, "w100500"s, DocumentStatus::ACTUAL, facets);
+    ASSERT_EQUAL(facets.GetMatchCount(), 0u);
+    ASSERT_EQUAL(facets.GetRatingCounts(), vector<size_t>{0});
+    facets.Add(DocumentStatus::BANNED, -1, false);
+    facets.Add(DocumentStatus::BANNED, 3, true);
+    ASSERT_EQUAL(facets.GetRatingCounts(), vector<size_t>{1});
+    ASSERT_EQUAL(facets.GetStatusCount(DocumentStatus::BANNED), 2u);
+    ASSERT_EQUAL(facets.GetHitCount(), 1u);
+}
+
+void TestQueryServer() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    search_server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    QueryServer query_server(search_server, "127.0.0.1"s, 0);
+    thread event_loop([&] {
+        query_server.Run();
+    });
+    auto get_ids = [](const string& response) {
+        vector<int> ids;
+        for (size_t tab = response.find('\t'); tab != response.npos; tab = response.find('\t', tab + 1)) {
+            ids.push_back(stoi(response.substr(tab + 1)));
+        }
+        return ids;
+    };
+
+    {
+        // Pipelined requests get their responses in order
+        QueryClient client("127.0.0.1"s, query_server.GetPort());
+        for (const string& request : {"FIND\tпушистый кот"s, "MATCH\t1\tбелый кот -хвост"s, "ADD\t3\tACTUAL\t5 6\tухоженный пёс"s,
+                                      "FIND\tпёс"s, "REMOVE\t3"s, "FIND\tпёс"s, "ADD\tx\tACTUAL\t5\tпёс"s, "JUMP"s}) {
+            client.Send(request);
+        }
+        const string response = client.Receive();
+        ASSERT_EQUAL(response.substr(0, 3), "OK\t"s);
+        ASSERT_EQUAL(get_ids(response), vector<int>({2, 1}));
+        ASSERT_EQUAL(client.Receive(), "OK\tACTUAL\tбелый кот"s);
+        ASSERT_EQUAL(client.Receive(), "OK"s);
+        ASSERT_EQUAL(get_ids(client.Receive()), vector<int>({3}));
+        ASSERT_EQUAL(client.Receive(), "OK"s);
+        ASSERT_EQUAL(client.Receive(), "OK"s);
+        ASSERT_EQUAL(client.Receive(), "ERROR\tInvalid number"s);
+        ASSERT_EQUAL(client.Receive(), "ERROR\tUnknown command"s);
+    }
+
+    // The bundled load client
+    vector<string> requests;
+    for (int i = 0; i < 400; ++i) {
+        requests.push_back(i % 2 == 0 ? "FIND\tпушистый"s : "MATCH\t2\tкот"s);
+    }
+    const LoadReport report = RunLoad("127.0.0.1"s, query_server.GetPort(), requests, 4, 8);
+    ASSERT_EQUAL(report.request_count, 400u);
+    ASSERT_EQUAL(report.error_count, 0u);
+    ASSERT(report.median_latency <= report.p99_latency && report.p99_latency <= report.max_latency);
+    const LoadReport unbounded_report = RunLoad("127.0.0.1"s, query_server.GetPort(), requests, 2, 0);
+    ASSERT_EQUAL(unbounded_report.request_count, 400u);
+    ASSERT_EQUAL(unbounded_report.error_count, 0u);
+
+    {
+        // Out of descriptors, the server accepts and closes a pending connection instead of waking up for it forever
+        const int pending = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const timeval timeout{5, 0};
+        setsockopt(pending, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(query_server.GetPort());
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        ssize_t received = -1;
+        {
+            // No descriptor is free while it lives, the limit is restored before anything can fail
+            class DescriptorLimit {
+            public:
+                DescriptorLimit() {
+                    getrlimit(RLIMIT_NOFILE, &saved_limit_);
+                    const int first_free = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    close(first_free);
+                    rlimit limit = saved_limit_;
+                    limit.rlim_cur = first_free;
+                    setrlimit(RLIMIT_NOFILE, &limit);
+                }
+                ~DescriptorLimit() {
+                    setrlimit(RLIMIT_NOFILE, &saved_limit_);
+                }
+
+            private:
+                rlimit saved_limit_{};
+            };
+            const DescriptorLimit limit;
+            connect(pending, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+            char byte = 0;
+            received = recv(pending, &byte, 1, 0);
+        }
+        close(pending);
+        ASSERT_EQUAL_HINT(received, 0, "A connection over the limit is closed"s);
+        QueryClient client("127.0.0.1"s, query_server.GetPort());
+        client.Send("FIND\tпушистый кот"s);
+        ASSERT_EQUAL(get_ids(client.Receive()), vector<int>({2, 1}));
+    }
+
+    query_server.Stop();
+    event_loop.join();
+}
+
+void TestQueryReplay() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    search_server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(3, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+
+    ostringstream log;
+    RequestQueue request_queue(search_server);
+    request_queue.SetQueryLog(&log);
+    request_queue.AddFindRequest("пушистый кот"s);
+    request_queue.AddFindRequest("пёс"s, DocumentStatus::BANNED);
+    request_queue.AddFindRequest("пёс"s, [](int, DocumentStatus, int) {
+        return true;
+    });
+    request_queue.SetQueryLog(nullptr);
+    request_queue.AddFindRequest("хвост"s);
+    ASSERT_EQUAL_HINT(log.str(), "ACTUAL\tпушистый кот\nBANNED\tпёс\nACTUAL\tпёс\n"s, "Requests are recorded until the log is detached"s);
+
+    istringstream input(log.str() + "\nACTUAL\tкот --хвост\n"s);
+    vector<LoggedQuery> queries = ReadQueryLog(input);
+    ASSERT_EQUAL(queries.size(), 4u);
+    ASSERT_EQUAL(queries[1].raw_query, "пёс"s);
+    ASSERT_HINT(queries[1].status == DocumentStatus::BANNED, "The status is read back"s);
+    istringstream bad_input("ACTUAL\tкот\nDELETED\tкот\n"s);
+    try {
+        ReadQueryLog(bad_input);
+        ASSERT_HINT(false, "Unknown status must throw"s);
+    } catch (const invalid_argument& error) {
+        ASSERT_EQUAL(string(error.what()), "Query log line 2: Unknown document status"s);
+    }
+
+    // A fourth of the queries find nothing and the last one is invalid
+    vector<LoggedQuery> replayed;
+    for (int i = 0; i < 100; ++i) {
+        replayed.insert(replayed.end(), queries.begin(), queries.end() - 1);
+        replayed.push_back({"хвост"s, DocumentStatus::ACTUAL});
+    }
+    replayed.back() = queries.back();
+    const ReplayReport closed_loop = ReplayQueryLog(search_server, replayed, ReplayOptions{ReplayMode::CLOSED_LOOP, 3, 0.0});
+    ASSERT_EQUAL(closed_loop.query_count, 400u);
+    ASSERT_EQUAL(closed_loop.empty_result_count, 100u);
+    ASSERT_EQUAL(closed_loop.error_count, 1u);
+    ASSERT(closed_loop.median_latency <= closed_loop.p99_latency && closed_loop.p99_latency <= closed_loop.p999_latency
+           && closed_loop.p999_latency <= closed_loop.max_latency);
+
+    // 400 queries at 4000 per second take at least a tenth of a second
+    const ReplayReport open_loop = ReplayQueryLog(search_server, replayed, ReplayOptions{ReplayMode::OPEN_LOOP, 2, 4000.0});
+    ASSERT_EQUAL(open_loop.empty_result_count, 100u);
+    ASSERT_HINT(open_loop.seconds >= 0.099 && open_loop.GetThroughput() <= 4040.0, "Open loop keeps the target rate"s);
+    try {
+        ReplayQueryLog(search_server, replayed, ReplayOptions{ReplayMode::OPEN_LOOP, 2, 0.0});
+        ASSERT_HINT(false, "Open loop without a rate must throw"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestQueryExplain() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    search_server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(3, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    search_server.AddDocument(4, "ухоженный скворец евгений"s, DocumentStatus::ACTUAL, {9});
+    const string query = "пушистый ухоженный кот -ошейник"s;
+
+    QueryExplain explain;
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, explain)),
+                 GetIds(search_server.FindTopDocuments(query)));
+    ASSERT_EQUAL(explain.words.size(), 4u);
+    ASSERT_EQUAL(explain.words[0].word, "кот"s);
+    ASSERT_EQUAL(explain.words[0].posting_count, 2u);
+    ASSERT_EQUAL(explain.words[0].inverse_document_freq, log(2.0));
+    ASSERT_EQUAL(explain.words[0].scanned_count, 2u);
+    ASSERT_EQUAL(explain.words[1].scanned_count, 1u);
+    ASSERT_EQUAL(explain.words[2].scanned_count, 2u);
+    ASSERT_HINT(explain.words[3].is_minus && explain.words[3].word == "ошейник"s, "Minus words follow the plus words"s);
+    ASSERT_EQUAL(explain.counters.matched_count, 3u);
+    ASSERT_EQUAL(explain.counters.predicate_rejected_count, 1u);
+    ASSERT_EQUAL(explain.counters.minus_removed_count, 1u);
+    ASSERT_EQUAL(explain.result_count, 2u);
+    ASSERT_HINT(!explain.is_champion_path && explain.path == ExecutionPath::SEQUENTIAL, "The posting lists are scored sequentially"s);
+    ASSERT_EQUAL(explain.counters.dense_range_count + explain.counters.merge_range_count, 1u);
+    ostringstream output;
+    output << explain;
+    ASSERT_HINT(output.str().find("path sequential"s) != string::npos, "The record prints its path"s);
+
+    // The record is reset and counts the same in parallel, whatever the ranges
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, explain)),
+                 GetIds(search_server.FindTopDocuments(query)));
+    ASSERT_EQUAL(explain.words.size(), 4u);
+    ASSERT_EQUAL(explain.words[2].scanned_count, 2u);
+    ASSERT_EQUAL(explain.counters.matched_count, 3u);
+    ASSERT_EQUAL(explain.counters.minus_removed_count, 1u);
+    ASSERT(explain.path != ExecutionPath::SEQUENTIAL);
+
+    search_server.FindTopDocuments(execution::seq, "+ухоженный кот"s, DocumentStatus::ACTUAL, explain);
+    ASSERT_EQUAL(explain.counters.intersection_range_count, 1u);
+    ASSERT_EQUAL(explain.words[1].is_required, true);
+    ASSERT_EQUAL(explain.counters.matched_count, 2u);
+    ASSERT_EQUAL(explain.counters.predicate_rejected_count, 1u);
+    ASSERT_EQUAL(explain.result_count, 1u);
+
+    // A few documents stand out, so the champion list of a frequent word proves the page
+    SearchServer champion_server("и в на"s);
+    for (int id = 0; id < 1000; ++id) {
+        const string text = id % 5 < 2 ? "пёс w"s + to_string(id % 40) : id < 10 ? "кот кот кот кот кот"s : "кот w"s + to_string(id % 40);
+        champion_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 11});
+    }
+    const vector<Document> champion_documents = champion_server.FindTopDocuments(execution::seq, "кот"s, DocumentStatus::ACTUAL, explain);
+    ASSERT_HINT(explain.is_champion_path, "The page comes from the champion list"s);
+    ASSERT_EQUAL(explain.words[0].posting_count, 600u);
+    ASSERT_EQUAL(explain.words[0].scanned_count, CHAMPION_LIST_SIZE);
+    ASSERT_EQUAL(explain.counters.matched_count, CHAMPION_LIST_SIZE);
+    ASSERT_EQUAL(explain.result_count, champion_documents.size());
+}
+
 void TestStatus() {
     SearchServer search_server("и в на с"s);
 
@@ -313,15 +1034,925 @@ void TestDontChangeQuery() { // test, что ParseQuery не изменяет з
 
 }
 
+void TestThreadPool() {
+    ThreadPool thread_pool(4);
+    ASSERT_EQUAL(thread_pool.GetThreadCount(), 4u);
+
+    vector<future<int>> futures;
+    for (int i = 0; i < 100; ++i) {
+        futures.push_back(thread_pool.Submit([i] { return i * i; }, i % 2 == 0 ? TaskPriority::HIGH : TaskPriority::LOW));
+    }
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQUAL(futures[i].get(), i * i);
+    }
+
+    // Nested loops must not deadlock: the caller runs every chunk no helper has taken
+    vector<atomic<int>> counters(10);
+    thread_pool.ParallelFor(counters.size(), [&](size_t i) {
+        thread_pool.ParallelFor(100, [&](size_t) { ++counters[i]; });
+    });
+    ASSERT(all_of(counters.begin(), counters.end(), [](const atomic<int>& counter) { return counter == 100; }));
+
+    bool is_thrown = false;
+    try {
+        thread_pool.ParallelFor(10, [](size_t i) {
+            if (i == 7) throw runtime_error("failed"s);
+        });
+    } catch (const runtime_error&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+
+    // A caller done with its chunks waits for the helpers instead of running unrelated tasks
+    ThreadPool small_pool(2);
+    promise<void> release;
+    future<void> blocker = small_pool.Submit([released = release.get_future().share()] { released.wait(); });
+    const thread::id caller_id = this_thread::get_id();
+    atomic<int> started_count = 0;
+    future<thread::id> unrelated;
+    small_pool.ParallelFor(2, [&](size_t) {
+        ++started_count;
+        while (started_count < 2) {
+            this_thread::yield();
+        }
+        if (this_thread::get_id() == caller_id) {
+            unrelated = small_pool.Submit([] { return this_thread::get_id(); }, TaskPriority::LOW);
+        } else {
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    });
+    release.set_value();
+    blocker.get();
+    ASSERT(unrelated.get() != caller_id);
+}
+
+void TestFindTopDocumentsAsync() {
+    SearchServer search_server("и в на"s);
+    ThreadPool thread_pool(2);
+    search_server.SetThreadPool(thread_pool);
+
+    search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+
+    future<vector<Document>> actual = search_server.FindTopDocumentsAsync("ухоженный кот"s);
+    future<vector<Document>> banned = search_server.FindTopDocumentsAsync("ухоженный кот"s, DocumentStatus::BANNED, TaskPriority::HIGH);
+    future<vector<Document>> even = search_server.FindTopDocumentsAsync("ухоженный кот"s, [](int id, DocumentStatus, int) {
+        return id % 2 == 0;
+    }, TaskPriority::LOW);
+
+    ASSERT_EQUAL(GetIds(actual.get()), GetIds(search_server.FindTopDocuments("ухоженный кот"s)));
+    ASSERT_EQUAL(GetIds(banned.get()), vector<int>({2}));
+    ASSERT_EQUAL(GetIds(even.get()), vector<int>({2, 0}));
+
+    const vector<string> queries = {"кот"s, "пёс"s, "хвост"s};
+    const vector<vector<Document>> results = ProcessQueries(search_server, queries);
+    ASSERT_EQUAL(results.size(), queries.size());
+    ASSERT_EQUAL(GetIds(results[0]), GetIds(search_server.FindTopDocuments("кот"s)));
+    ASSERT(results[1].empty());
+    ASSERT_EQUAL(GetIds(results[2]), vector<int>({1}));
+}
+
+void TestAdaptiveExecution() {
+    SearchServer search_server("и в на"s);
+    ThreadPool thread_pool(2);
+    search_server.SetThreadPool(thread_pool);
+
+    const vector<string> words = {"кот"s, "пёс"s, "хвост"s, "ошейник"s, "попугай"s, "белый"s, "чёрный"s};
+    for (int id = 0; id < 500; ++id) {
+        string text;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id + 1) % static_cast<int>(i + 2) == 0 || id % 7 == static_cast<int>(i)) {
+                text += words[i] + " "s;
+            }
+        }
+        search_server.AddDocument(id, text + "и"s, DocumentStatus::ACTUAL, {id % 10});
+    }
+
+    const vector<string> queries = {"кот"s, "кот пёс -хвост"s, "кот пёс хвост ошейник попугай белый"s, "чёрный -белый"s, "жираф"s};
+
+    // Free dispatch makes every query parallel
+    ExecutionThresholds always_parallel;
+    always_parallel.dispatch_cost = 0.0;
+    ExecutionThresholds never_parallel;
+    never_parallel.dispatch_cost = 1e30;
+    for (const ExecutionThresholds& thresholds : {always_parallel, never_parallel}) {
+        search_server.SetExecutionThresholds(thresholds);
+        for (const string& query : queries) {
+            ASSERT_EQUAL_HINT(GetIds(search_server.FindTopDocuments(adaptive_execution, query)), GetIds(search_server.FindTopDocuments(query)), query);
+            ASSERT(search_server.MatchDocuments(adaptive_execution, query, {0, 1, 2}) == search_server.MatchDocuments(query, {0, 1, 2}));
+        }
+    }
+}
+
+void TestMemoryResources() {
+    CountingResource index_resource;
+    {
+        SearchServer search_server("и в на"s, &index_resource);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        ASSERT(index_resource.GetAllocationCount() > 0);
+        ASSERT(index_resource.GetBytesInUse() > 0);
+
+        // Query temporaries come from the arena of the query, not from the index
+        const size_t allocation_count = index_resource.GetAllocationCount();
+        ASSERT_EQUAL(search_server.FindTopDocuments("пушистый кот -ошейник"s).size(), 1u);
+        ASSERT_EQUAL(get<0>(search_server.MatchDocument("пушистый кот"s, 1)).size(), 2u);
+        ASSERT_EQUAL(index_resource.GetAllocationCount(), allocation_count);
+
+        search_server.RemoveDocument(0);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 1);
+    }
+    ASSERT_EQUAL(index_resource.GetBytesInUse(), 0u);
+    ASSERT(index_resource.GetPeakBytesInUse() > 0);
+}
+
+void TestMemoryBudget() {
+    CountingResource index_resource;
+    SearchServer search_server("и в на"s, &index_resource);
+    auto add_documents = [&](int first_id, int count) {
+        for (int id = first_id; id < first_id + count; ++id) {
+            search_server.AddDocument(id, "кот w"s + to_string(id % 100) + " w"s + to_string(id % 37) + " пёс"s,
+                                      DocumentStatus::ACTUAL, {id % 11});
+        }
+    };
+    add_documents(0, 300);
+    MemoryStats stats = search_server.GetMemoryStats();
+    ASSERT(stats.words > 0 && stats.forward_index > 0 && stats.documents > 0 && stats.ids > 0 && stats.rating_index > 0);
+    ASSERT_EQUAL_HINT(stats.sealed_segments, 0u, "Nothing is sealed yet"s);
+    ASSERT_EQUAL_HINT(stats.GetTotal(), index_resource.GetBytesInUse(), "Every byte of the index is counted for some structure"s);
+    const size_t mutable_segment = stats.mutable_segment;
+    search_server.FlushSegment();
+    stats = search_server.GetMemoryStats();
+    ASSERT(stats.sealed_segments > 0 && stats.mutable_segment < mutable_segment);
+    ASSERT_EQUAL(stats.GetTotal(), index_resource.GetBytesInUse());
+
+    // Rejected documents change nothing
+    search_server.SetMemoryBudget({stats.GetTotal(), MemoryBudgetPolicy::REJECT});
+    try {
+        add_documents(300, 1);
+        ASSERT_HINT(false, "A document over the budget must be rejected"s);
+    } catch (const MemoryBudgetExceeded&) {
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 300);
+    ASSERT_EQUAL(search_server.GetMemoryStats().GetTotal(), stats.GetTotal());
+
+    // Postings of removed documents are given back by the compaction the budget triggers
+    search_server.SetMemoryBudget({});
+    for (int i = 0; i < 5; ++i) {
+        add_documents(1000 + i * 300, 300);
+        search_server.FlushSegment();
+    }
+    search_server.WaitForMerges();
+    for (int id = 1000; id < 2500; ++id) {
+        search_server.RemoveDocument(id);
+    }
+    const set<int> expected_ids = GetIdSet(search_server.FindTopDocuments("w1 -w0"s));
+    const MemoryStats removed_stats = search_server.GetMemoryStats();
+    search_server.SetMemoryBudget({removed_stats.GetTotal() - removed_stats.sealed_segments / 4, MemoryBudgetPolicy::REJECT});
+    add_documents(300, 1);
+    ASSERT_EQUAL(search_server.GetSegmentCount(), 1u);
+    stats = search_server.GetMemoryStats();
+    ASSERT(stats.sealed_segments < removed_stats.sealed_segments);
+    ASSERT_HINT(stats.forward_index < removed_stats.forward_index && stats.documents < removed_stats.documents
+                && stats.rating_index < removed_stats.rating_index, "Removed documents leave every structure"s);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 301);
+    ASSERT_EQUAL(GetIdSet(search_server.FindTopDocuments("w1 -w0"s)), expected_ids);
+
+    // Throttled documents still over the limit are rejected after a delay
+    search_server.SetMemoryBudget({1, MemoryBudgetPolicy::THROTTLE, chrono::milliseconds(20)});
+    const auto start = chrono::steady_clock::now();
+    try {
+        add_documents(301, 1);
+        ASSERT_HINT(false, "A throttled document over the budget must be rejected"s);
+    } catch (const MemoryBudgetExceeded&) {
+    }
+    ASSERT(chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 301);
+
+    // Replaced texts of updated documents count for the compaction like removed ones
+    search_server.SetMemoryBudget({});
+    add_documents(3000, 300);
+    search_server.FlushSegment();
+    search_server.WaitForMerges();
+    for (int id = 3000; id < 3300; ++id) {
+        search_server.UpdateDocument(id, "попугай w"s + to_string(id));
+    }
+    search_server.FlushSegment();
+    search_server.WaitForMerges();
+    const MemoryStats updated_stats = search_server.GetMemoryStats();
+    search_server.SetMemoryBudget({updated_stats.GetTotal() - updated_stats.sealed_segments / 4, MemoryBudgetPolicy::REJECT});
+    search_server.UpdateDocument(3000, "попугай"s);
+    ASSERT_EQUAL(search_server.GetSegmentCount(), 1u);
+    stats = search_server.GetMemoryStats();
+    ASSERT(stats.sealed_segments < updated_stats.sealed_segments && stats.forward_index < updated_stats.forward_index);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 601);
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("попугай"s)).front(), 3000);
+}
+
+void TestLoadCorpus() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test_corpus.tsv"s).string();
+    {
+        ofstream corpus(path);
+        corpus << "0\tACTUAL\t8 -3\tбелый кот и модный ошейник\n"s
+               << "\n"s
+               << "1\tACTUAL\t7 2 7\tпушистый кот пушистый хвост\r\n"s
+               << "2\tBANNED\t\tухоженный пёс выразительные глаза"s;
+    }
+    SearchServer search_server("и в на"s);
+    ASSERT_EQUAL(LoadCorpus(search_server, path, 2), 3u);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+
+    const vector<Document> documents = search_server.FindTopDocuments("пушистый кот"s);
+    ASSERT_EQUAL(documents.size(), 2u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    ASSERT_EQUAL(documents[0].rating, 5);
+    ASSERT_EQUAL(documents[1].rating, 2);
+    ASSERT(get<0>(search_server.MatchDocument("хвост"s, 1)) == vector<string_view>({"хвост"sv}));
+    ASSERT_EQUAL(search_server.FindTopDocuments("пёс"s, DocumentStatus::BANNED).size(), 1u);
+
+    {
+        ofstream corpus(path);
+        corpus << "3\tACTUAL\t1\tчерная собака\n"s
+               << "4\tLOST\t1\tпопугай\n"s;
+    }
+    SearchServer other_server("и в на"s);
+    string error;
+    try {
+        LoadCorpus(other_server, path);
+    } catch (const invalid_argument& e) {
+        error = e.what();
+    }
+    ASSERT_HINT(error.find("line 2"s) != string::npos, error);
+    ASSERT_EQUAL_HINT(other_server.GetDocumentCount(), 1, "The line before the malformed one is added from the same batch"s);
+    ASSERT_EQUAL(other_server.FindTopDocuments("собака"s).size(), 1u);
+    filesystem::remove(path);
+}
+
+void TestWriteAheadLog() {
+    const string path = (filesystem::temp_directory_path() / "search_server_test.wal"s).string();
+    filesystem::remove(path);
+    {
+        WriteAheadLog log(path);
+        SearchServer search_server("и в на"s);
+        search_server.SetWriteAheadLog(&log);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {});
+        search_server.RemoveDocument(0);
+        // Neither rejected nor no-op mutations are logged
+        try {
+            search_server.AddDocument(1, "кот"s, DocumentStatus::ACTUAL, {1});
+        } catch (const invalid_argument&) {
+        }
+        search_server.RemoveDocument(0);
+
+        // Concurrent appenders share syncs
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&log, writer] {
+                for (int i = 0; i < 5; ++i) {
+                    log.LogAddDocument(100 + writer * 5 + i, "попугай"s, DocumentStatus::ACTUAL, {1});
+                }
+            });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+    }
+    {
+        // A torn record left by a crash
+        ofstream log(path, ios::binary | ios::app);
+        log << "\x20\x00\x00"s;
+    }
+
+    SearchServer replayed("и в на"s);
+    ASSERT_EQUAL(ReplayWriteAheadLog(path, replayed), 24u);
+    ASSERT_EQUAL(replayed.GetDocumentCount(), 22);
+    const vector<Document> documents = replayed.FindTopDocuments("пушистый кот"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    ASSERT_EQUAL(documents[0].rating, 5);
+    ASSERT_EQUAL(replayed.FindTopDocuments("пёс"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(replayed.FindTopDocuments("попугай"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    size_t record_count = 24;
+    for (const DurabilityMode mode : {DurabilityMode::PERIODIC, DurabilityMode::GROUP_COMMIT, DurabilityMode::SYNC}) {
+        {
+            // The tail was cut, so new records follow the valid ones
+            WriteAheadLog log(path, mode);
+            log.LogRemoveDocument(1);
+            log.LogAddDocument(1, "рыжий кот"s, DocumentStatus::ACTUAL, {3});
+            log.Sync();
+        }
+        SearchServer search_server("и в на"s);
+        ASSERT_EQUAL(ReplayWriteAheadLog(path, search_server), record_count + 2);
+        ASSERT(get<0>(search_server.MatchDocument("рыжий пушистый"s, 1)) == vector<string_view>({"рыжий"sv}));
+
+        WriteAheadLog log(path, mode);
+        log.Truncate();
+        SearchServer empty_server("и в на"s);
+        ASSERT_EQUAL(ReplayWriteAheadLog(path, empty_server), 0u);
+        record_count = 0;
+    }
+
+    // A batch waits for one sync, records outside of it for one each
+    {
+        WriteAheadLog log(path);
+        SearchServer search_server("и в на"s);
+        search_server.SetWriteAheadLog(&log);
+        search_server.RunWriteBatch([&search_server] {
+            for (int id = 0; id < 50; ++id) {
+                search_server.AddDocument(id, "попугай"s, DocumentStatus::ACTUAL, {1});
+            }
+        });
+        const uint64_t batch_sync_count = log.GetSyncCount();
+        ASSERT_HINT(batch_sync_count >= 1 && batch_sync_count < 5, to_string(batch_sync_count));
+        search_server.AddDocument(50, "попугай"s, DocumentStatus::ACTUAL, {1});
+        search_server.AddDocument(51, "попугай"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(log.GetSyncCount(), batch_sync_count + 2);
+    }
+    SearchServer batch_server("и в на"s);
+    ASSERT_EQUAL(ReplayWriteAheadLog(path, batch_server), 52u);
+
+    filesystem::remove(path);
+    SearchServer first_start_server("и в на"s);
+    ASSERT_EQUAL_HINT(ReplayWriteAheadLog(path, first_start_server), 0u, "A missing log is empty"s);
+}
+
+void TestSegments() {
+    ThreadPool thread_pool(2);
+    SearchServer search_server("и в на"s);
+    search_server.SetThreadPool(thread_pool);
+    // The whole index stays in the mutable segment
+    SearchServer reference_server("и в на"s);
+
+    const vector<string> words = {"кот"s, "пёс"s, "хвост"s, "ошейник"s, "попугай"s, "белый"s, "чёрный"s};
+    for (int id = 0; id < 40; ++id) {
+        string text;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id + 1) % static_cast<int>(i + 2) == 0 || id % 7 == static_cast<int>(i)) {
+                text += words[i] + " "s;
+            }
+        }
+        for (SearchServer* server : {&search_server, &reference_server}) {
+            server->AddDocument(id * 3, text + "и"s, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 10});
+        }
+        if (id % 5 == 4) {
+            search_server.FlushSegment();
+        }
+    }
+    // Eight sealed segments of tier 0 make two of tier 1
+    search_server.WaitForMerges();
+    ASSERT_EQUAL(search_server.GetSegmentCount(), 2u);
+
+    const vector<string> queries = {"кот"s, "кот пёс -хвост"s, "кот пёс хвост ошейник попугай белый"s, "чёрный -белый"s, "жираф"s};
+    ExecutionThresholds always_parallel;
+    always_parallel.dispatch_cost = 0.0;
+    search_server.SetExecutionThresholds(always_parallel);
+    auto check_queries = [&] {
+        for (const string& query : queries) {
+            const vector<Document> expected = reference_server.FindTopDocuments(query);
+            for (const vector<Document>& documents : {search_server.FindTopDocuments(query),
+                                                      search_server.FindTopDocuments(execution::par, query),
+                                                      search_server.FindTopDocuments(adaptive_execution, query)}) {
+                AssertSameDocuments(documents, expected, query);
+            }
+            ASSERT(search_server.FindTopDocuments(query, DocumentStatus::BANNED).size()
+                   == reference_server.FindTopDocuments(query, DocumentStatus::BANNED).size());
+        }
+    };
+    check_queries();
+
+    // Removed documents are skipped until compaction drops their postings
+    for (const int id : {0, 9, 21, 60, 117}) {
+        search_server.RemoveDocument(id);
+        reference_server.RemoveDocument(id);
+    }
+    search_server.AddDocument(200, "кот кот попугай"s, DocumentStatus::ACTUAL, {5});
+    reference_server.AddDocument(200, "кот кот попугай"s, DocumentStatus::ACTUAL, {5});
+    check_queries();
+    search_server.Compact();
+    ASSERT_EQUAL(search_server.GetSegmentCount(), 1u);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), reference_server.GetDocumentCount());
+    check_queries();
+}
+
+void TestImpactScores() {
+    SearchServer search_server("и в на"s);
+    SearchServer reference_server("и в на"s);
+    auto add_documents = [&](int first_id, int last_id) {
+        for (int id = first_id; id < last_id; ++id) {
+            const string text = MakeTestText({id * 3 % 4, 0, id * 5 % 4, id * 6 % 4, id * 7 % 4}, id % 7);
+            for (SearchServer* server : {&search_server, &reference_server}) {
+                server->AddDocument(id, text, DocumentStatus::ACTUAL, {id % 10});
+            }
+            if (id % 10 == 9) {
+                search_server.FlushSegment();
+            }
+        }
+    };
+    add_documents(0, 30);
+
+    // Every document is compared alone, so that ties broken differently by rounding don't matter
+    const vector<string> queries = {"кот"s, "кот пёс -хвост"s, "пёс хвост ошейник попугай"s, "+кот попугай"s, "коот~1"s};
+    auto count_quantized = [&](double tolerance) {
+        int quantized_count = 0;
+        for (const string& query : queries) {
+            for (int id = 0; id < search_server.GetDocumentCount(); ++id) {
+                auto only_id = [id](int document_id, DocumentStatus, int) {
+                    return document_id == id;
+                };
+                const vector<Document> expected = reference_server.FindTopDocuments(query, only_id);
+                const vector<Document> documents = search_server.FindTopDocuments(query, only_id);
+                ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+                if (!expected.empty()) {
+                    ASSERT_HINT(abs(documents[0].relevance - expected[0].relevance) <= tolerance, query);
+                    quantized_count += abs(documents[0].relevance - expected[0].relevance) > 1e-12;
+                }
+            }
+        }
+        return quantized_count;
+    };
+    ASSERT_EQUAL(count_quantized(1e-12), 0);
+
+    search_server.SetImpactPrecision(ImpactPrecision::BITS_16);
+    ASSERT(count_quantized(1e-3) > 0);
+    search_server.SetImpactPrecision(ImpactPrecision::BITS_8);
+    ASSERT(count_quantized(0.05) > 0);
+
+    // New documents with every word shift the IDFs, stale segments are scored exactly until the next seal
+    for (int id = 30; id < 45; ++id) {
+        for (SearchServer* server : {&search_server, &reference_server}) {
+            server->AddDocument(id, "кот пёс хвост ошейник попугай"s, DocumentStatus::ACTUAL, {1});
+        }
+    }
+    ASSERT_EQUAL(count_quantized(1e-12), 0);
+    search_server.FlushSegment();
+    ASSERT(count_quantized(0.05) > 0);
+}
+
+void TestScoreKernels() {
+    mt19937 generator(7);
+    const int base = 1000;
+    const size_t document_count = 5000;
+    vector<int> internal_ids;
+    vector<double> term_freqs;
+    for (int offset = 0; offset < static_cast<int>(document_count); ++offset) {
+        if (generator() % 3 == 0) {
+            internal_ids.push_back(base + offset);
+            term_freqs.push_back(1.0 / (generator() % 10 + 1));
+        }
+    }
+    vector<int> minus_ids;
+    for (int offset = 0; offset < static_cast<int>(document_count); offset += 7) {
+        minus_ids.push_back(base + offset);
+    }
+    vector<uint32_t> exclusion_mask(GetExclusionMaskSize(document_count), 0);
+    AddToExclusionMask(minus_ids.data(), minus_ids.size(), base, document_count, exclusion_mask.data());
+
+    // Lists of every length hit the vectorized blocks and the scalar tail
+    vector<double> expected(document_count, 0.5);
+    for (size_t i = 0; i < internal_ids.size(); ++i) {
+        if ((internal_ids[i] - base) % 7 != 0) {
+            expected[internal_ids[i] - base] += 0.25 * term_freqs[i];
+        }
+    }
+    for (const ScoreKernel kernel : {ScoreKernel::SCALAR, ScoreKernel::AVX2, ScoreKernel::AVX512}) {
+        if (!IsScoreKernelSupported(kernel)) {
+            continue;
+        }
+        vector<double> scores(document_count, 0.5);
+        AccumulateScores(kernel, internal_ids.data(), term_freqs.data(), 13, 0.25, base, exclusion_mask.data(), scores.data());
+        AccumulateScores(kernel, internal_ids.data() + 13, term_freqs.data() + 13, internal_ids.size() - 13, 0.25, base,
+                         exclusion_mask.data(), scores.data());
+        for (size_t offset = 0; offset < document_count; ++offset) {
+            ASSERT_HINT(abs(scores[offset] - expected[offset]) < 1e-12, to_string(static_cast<int>(kernel)));
+        }
+    }
+
+    // Dense scoring finds what merging the posting lists finds
+    SearchServer search_server("и в на"s);
+    for (int id = 0; id < 300; ++id) {
+        const string text = MakeTestText({generator() % 2 == 0, generator() % 3 == 0, generator() % 4 == 0, generator() % 5 == 0,
+                                          generator() % 6 == 0}, id % 13);
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 10});
+        if (id == 150) {
+            search_server.FlushSegment();
+        }
+    }
+    search_server.RemoveDocument(10);
+    ExecutionThresholds merging;
+    merging.min_dense_scoring_density = numeric_limits<double>::infinity();
+    ExecutionThresholds dense;
+    dense.min_dense_scoring_density = 0.0;
+    for (const string& query : {"кот пёс"s, "кот пёс хвост -ошейник"s, "хвост попугай w3 -w5 -кот"s}) {
+        search_server.SetExecutionThresholds(merging);
+        const vector<Document> expected_documents = search_server.FindTopDocuments(query, [](int id, DocumentStatus, int) {
+            return id % 4 != 0;
+        });
+        search_server.SetExecutionThresholds(dense);
+        const vector<Document> documents = search_server.FindTopDocuments(query, [](int id, DocumentStatus, int) {
+            return id % 4 != 0;
+        });
+        AssertSameDocuments(documents, expected_documents, query);
+    }
+}
+
+void TestDocumentReordering() {
+    SearchServer search_server("и в на"s);
+    // Documents of two topics come interleaved, so every posting list of a topic has gaps of two
+    const vector<string> pets = {"кот"s, "пёс"s, "хвост"s, "ошейник"s, "попугай"s, "корм"s};
+    const vector<string> city = {"улица"s, "дом"s, "мост"s, "трамвай"s, "площадь"s, "парк"s};
+    for (int id = 0; id < 600; ++id) {
+        const vector<string>& words = id % 2 == 0 ? pets : city;
+        string text;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id / 2 + i) % 3 != 0) {
+                text += words[i] + " "s;
+            }
+        }
+        search_server.AddDocument(id, text + "и"s, id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+    }
+    search_server.RemoveDocument(10);
+    search_server.RemoveDocument(11);
+    search_server.Compact();
+
+    const vector<string> queries = {"кот"s, "кот пёс -хвост"s, "улица дом мост"s, "парк кот"s, "попуг*"s, "трамвай -площадь"s};
+    vector<vector<Document>> expected_documents;
+    vector<map<string_view, double>> expected_freqs;
+    for (const string& query : queries) {
+        expected_documents.push_back(search_server.FindTopDocuments(query));
+    }
+    for (int id = 0; id < 600; ++id) {
+        map<string_view, double> freqs;
+        for (const auto& [word, freq] : search_server.GetWordFrequencies(id)) {
+            freqs[word] = freq;
+        }
+        expected_freqs.push_back(move(freqs));
+    }
+    const size_t delta_bits = search_server.GetDeltaEncodedPostingBits();
+
+    search_server.ReorderDocuments();
+    ASSERT_EQUAL(search_server.GetSegmentCount(), 1u);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 598);
+    ASSERT_HINT(search_server.GetDeltaEncodedPostingBits() < delta_bits, to_string(search_server.GetDeltaEncodedPostingBits()));
+    // External ids, relevance and the forward index don't change
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(search_server.FindTopDocuments(queries[i]), expected_documents[i], queries[i]);
+    }
+    for (int id = 0; id < 600; ++id) {
+        map<string_view, double> freqs;
+        for (const auto& [word, freq] : search_server.GetWordFrequencies(id)) {
+            freqs[word] = freq;
+        }
+        ASSERT_EQUAL_HINT(freqs, expected_freqs[id], to_string(id));
+    }
+    const auto [words, status] = search_server.MatchDocument("кот пёс улица"s, 14);
+    ASSERT(status == DocumentStatus::BANNED);
+    ASSERT_EQUAL(words.size(), 2u);
+
+    // The index keeps taking and removing documents
+    search_server.RemoveDocument(4);
+    search_server.AddDocument(1000, "кот кот кот"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.FindTopDocuments("кот"s).front().id, 1000);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 598);
+    for (const Document& document : search_server.FindTopDocuments("кот пёс хвост"s)) {
+        ASSERT(document.id != 4);
+    }
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1000).size(), 1u);
+}
+
+void TestPagination() {
+    SearchServer search_server("и в на"s);
+    // Many documents share relevance and rating, so the cursor has to break ties by id
+    for (int id = 0; id < 300; ++id) {
+        string text = "кот"s;
+        for (int i = 0; i < id % 4; ++i) {
+            text += " хвост"s;
+        }
+        search_server.AddDocument(id, text + (id % 3 == 0 ? " пёс"s : ""s), id % 10 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 5});
+        if (id % 100 == 99) {
+            search_server.FlushSegment();
+        }
+    }
+    search_server.RemoveDocument(42);
+
+    for (const string& query : {"кот"s, "кот пёс"s, "пёс -хвост"s}) {
+        const vector<Document> all_documents = search_server.FindTopDocumentsAfter(query, nullopt, 1000);
+        for (size_t i = 1; i < all_documents.size(); ++i) {
+            ASSERT_HINT(all_documents[i - 1].relevance >= all_documents[i].relevance - 1e-6, query);
+        }
+        ASSERT_EQUAL_HINT(search_server.FindTopDocuments(query).front().id, all_documents.front().id, query);
+
+        for (const size_t page_size : {1u, 7u, 50u}) {
+            vector<Document> paged_documents;
+            optional<Document> cursor;
+            while (true) {
+                const vector<Document> page = search_server.FindTopDocumentsAfter(execution::par, query, cursor, page_size);
+                ASSERT_HINT(page.size() <= page_size, query);
+                if (page.empty()) {
+                    break;
+                }
+                paged_documents.insert(paged_documents.end(), page.begin(), page.end());
+                cursor = page.back();
+            }
+            AssertSameDocuments(paged_documents, all_documents, query);
+        }
+    }
+
+    // Pages of a filtered query
+    const auto is_even = [](int id, DocumentStatus, int) {
+        return id % 2 == 0;
+    };
+    const vector<Document> first_page = search_server.FindTopDocumentsAfter("кот"s, nullopt, 10, is_even);
+    const vector<Document> second_page = search_server.FindTopDocumentsAfter("кот"s, first_page.back(), 10, is_even);
+    ASSERT_EQUAL(second_page.size(), 10u);
+    for (const Document& document : second_page) {
+        ASSERT(document.id % 2 == 0);
+        ASSERT(count_if(first_page.begin(), first_page.end(), [&](const Document& other) { return other.id == document.id; }) == 0);
+    }
+    ASSERT(search_server.FindTopDocumentsAfter("кот"s, nullopt, 0).empty());
+    ASSERT_EQUAL(search_server.FindTopDocumentsAfter("кот"s, nullopt, 1000, DocumentStatus::BANNED).size(), 30u);
+
+    // Lazy pages are the same as the eager ones
+    const vector<int> numbers = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    const list<int> number_list(numbers.begin(), numbers.end());
+    const auto eager_pages = Paginate(numbers, 3);
+    const auto lazy_pages = PaginateLazily(numbers, 3);
+    const auto lazy_list_pages = PaginateLazily(number_list, 3);
+    ASSERT_EQUAL(lazy_pages.size(), 4);
+    ASSERT_EQUAL(lazy_list_pages.size(), 4);
+    auto eager_page = eager_pages.begin();
+    auto list_page = lazy_list_pages.begin();
+    for (const auto page : lazy_pages) {
+        ASSERT_EQUAL(vector<int>(page.begin(), page.end()), vector<int>(eager_page->begin(), eager_page->end()));
+        ASSERT_EQUAL(vector<int>((*list_page).begin(), (*list_page).end()), vector<int>(page.begin(), page.end()));
+        ++eager_page;
+        ++list_page;
+    }
+    ASSERT(list_page == lazy_list_pages.end());
+    ASSERT_EQUAL(lazy_pages[3].size(), 1);
+    ASSERT_EQUAL(*lazy_pages[2].begin(), 7);
+    ASSERT(lazy_pages[4].begin() == numbers.end());
+}
+
+void TestQueryBudget() {
+    SearchServer search_server("и в на"s);
+    // Budgets bound the scoring of segments, head queries must not be answered from the champion lists
+    ExecutionThresholds thresholds;
+    thresholds.use_champion_lists = false;
+    search_server.SetExecutionThresholds(thresholds);
+    for (int id = 0; id < 20000; ++id) {
+        search_server.AddDocument(id, id % 3 == 0 ? "кот пёс"s : "кот хвост"s, DocumentStatus::ACTUAL, {id % 100});
+    }
+    const vector<Document> expected_documents = search_server.FindTopDocuments("кот пёс"s);
+
+    // A budget that is never reached changes nothing
+    {
+        QueryBudget budget;
+        budget.SetTimeout(chrono::hours(1)).SetMaxPostings(1000000);
+        const vector<Document> documents = search_server.FindTopDocuments(execution::par, "кот пёс"s, DocumentStatus::ACTUAL, budget);
+        ASSERT(!budget.IsExhausted());
+        AssertSameDocuments(documents, expected_documents, "кот пёс"s);
+    }
+    // A work budget stops the query after a few blocks with the best documents of the blocks it went through
+    {
+        QueryBudget budget;
+        budget.SetMaxPostings(3 * BUDGET_CHECK_INTERVAL);
+        const vector<Document> documents = search_server.FindTopDocuments(execution::seq, "кот пёс"s, DocumentStatus::ACTUAL, budget);
+        ASSERT(budget.IsExhausted());
+        ASSERT(!budget.IsCancelled());
+        ASSERT_EQUAL(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+        ASSERT(budget.GetSpentPostings() <= 4 * BUDGET_CHECK_INTERVAL + 2);
+    }
+    // Past deadlines and cancelled budgets stop the query at once
+    {
+        QueryBudget budget;
+        budget.SetDeadline(QueryBudget::Clock::now() - chrono::seconds(1));
+        search_server.FindTopDocuments(execution::par, "кот"s, DocumentStatus::ACTUAL, budget);
+        ASSERT(budget.IsExhausted());
+    }
+    {
+        QueryBudget budget;
+        budget.Cancel();
+        ASSERT(search_server.FindTopDocuments(execution::seq, "кот пёс"s, DocumentStatus::ACTUAL, budget).empty());
+        ASSERT(budget.IsCancelled());
+    }
+    // Another thread cancels a running query: the predicate holds the first document until the cancellation
+    {
+        QueryBudget budget;
+        atomic<bool> is_started = false;
+        auto document_predicate = [&](int document_id, DocumentStatus status, int rating) {
+            if (!is_started.exchange(true)) {
+                while (!budget.IsCancelled()) {
+                    this_thread::yield();
+                }
+            }
+            return true;
+        };
+        vector<Document> documents;
+        thread query_thread([&] {
+            documents = search_server.FindTopDocuments(execution::seq, "кот"s, document_predicate, budget);
+        });
+        while (!is_started) {
+            this_thread::yield();
+        }
+        budget.Cancel();
+        query_thread.join();
+        ASSERT(budget.IsExhausted());
+        ASSERT(budget.GetSpentPostings() <= BUDGET_CHECK_INTERVAL + 1);
+        ASSERT(!documents.empty());
+    }
+}
+
+void TestChampionLists() {
+    SearchServer search_server("и в на"s);
+    SearchServer exact_server("и в на"s);
+    ExecutionThresholds exact_thresholds;
+    exact_thresholds.use_champion_lists = false;
+    exact_server.SetExecutionThresholds(exact_thresholds);
+
+    auto add_document = [&](int id, int cat_count, int filler_count) {
+        const string text = MakeTestText({cat_count, id % 2 == 0, id % 7 == 0, 0, id % 2 == 1}, id % 50, filler_count);
+        for (SearchServer* server : {&search_server, &exact_server}) {
+            server->AddDocument(id, text, id % 9 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 11});
+        }
+    };
+    for (int id = 0; id < 3000; ++id) {
+        add_document(id, id % 4 == 3 ? 0 : id * 7 % 5 + 1, id % 13 + 1);
+    }
+
+    const vector<string> queries = {"кот"s, "кот пёс"s, "кот -хвост"s, "+пёс кот"s, "кот попугай -хвост"s, "кот w3"s};
+    auto check_queries = [&] {
+        for (const string& query : queries) {
+            const vector<vector<Document>> pages = {
+                search_server.FindTopDocuments(query),
+                search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED),
+                search_server.FindTopDocuments(query, [](int id, DocumentStatus, int) { return id % 3 == 0; }),
+                search_server.FindTopDocumentsAfter(query, nullopt, 20),
+            };
+            const vector<vector<Document>> expected_pages = {
+                exact_server.FindTopDocuments(query),
+                exact_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED),
+                exact_server.FindTopDocuments(query, [](int id, DocumentStatus, int) { return id % 3 == 0; }),
+                exact_server.FindTopDocumentsAfter(query, nullopt, 20),
+            };
+            for (size_t i = 0; i < pages.size(); ++i) {
+                AssertSameDocuments(pages[i], expected_pages[i], query);
+            }
+        }
+    };
+    check_queries();
+
+    // A head query looks at its champion list only
+    int predicate_call_count = 0;
+    search_server.FindTopDocuments("кот"s, [&](int id, DocumentStatus, int) {
+        ++predicate_call_count;
+        return true;
+    });
+    ASSERT_HINT(predicate_call_count <= static_cast<int>(CHAMPION_LIST_SIZE), to_string(predicate_call_count));
+
+    // Removing the champions and adding better ones keeps the lists exact
+    for (int round = 0; round < 3; ++round) {
+        for (const Document& document : exact_server.FindTopDocumentsAfter("кот"s, nullopt, 50)) {
+            search_server.RemoveDocument(document.id);
+            exact_server.RemoveDocument(document.id);
+        }
+        check_queries();
+    }
+    for (int id = 5000; id < 5010; ++id) {
+        add_document(id, 20, 1);
+    }
+    check_queries();
+    ASSERT(search_server.FindTopDocuments("кот"s).front().id >= 5000);
+    search_server.ReorderDocuments();
+    exact_server.Compact();
+    check_queries();
+}
+
+void TestUpdateDocument() {
+    // Attributes change in place
+    {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+        search_server.AddDocument(2, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        search_server.UpdateDocumentAttributes(2, DocumentStatus::BANNED, {9});
+        ASSERT_EQUAL(search_server.FindTopDocuments("кот"s).size(), 1u);
+        const vector<Document> banned = search_server.FindTopDocuments("кот"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(banned.size(), 1u);
+        ASSERT_EQUAL(banned[0].id, 2);
+        ASSERT_EQUAL(banned[0].rating, 9);
+        ASSERT(get<1>(search_server.MatchDocument("кот"s, 2)) == DocumentStatus::BANNED);
+        try {
+            search_server.UpdateDocumentAttributes(3, DocumentStatus::ACTUAL, {});
+            ASSERT(false);
+        } catch (const out_of_range&) {
+        }
+        try {
+            search_server.UpdateDocument(3, "кот"s);
+            ASSERT(false);
+        } catch (const out_of_range&) {
+        }
+    }
+
+    // Text updates leave the index as remove and add would
+    SearchServer search_server("и в на"s);
+    SearchServer reference_server("и в на"s);
+    auto make_text = [](int seed) {
+        return MakeTestText({seed % 3, (seed + 1) % 3, (seed + 2) % 3, seed % 3, (seed + 1) % 3, (seed + 2) % 3}, seed % 17);
+    };
+    for (int id = 0; id < 1500; ++id) {
+        for (SearchServer* server : {&search_server, &reference_server}) {
+            server->AddDocument(id, make_text(id), id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 7});
+        }
+    }
+    mt19937 generator(12);
+    for (int i = 0; i < 700; ++i) {
+        const int id = static_cast<int>(generator() % 1500);
+        const string text = make_text(static_cast<int>(generator() % 100));
+        search_server.UpdateDocument(id, text);
+        const DocumentStatus status = id % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        reference_server.RemoveDocument(id);
+        reference_server.AddDocument(id, text, status, {id % 7});
+    }
+    // Updates are logged unless they change nothing: the text of seed 58 has the same terms as the one of seed 7
+    const string path = (filesystem::temp_directory_path() / "search_server_update_test.wal"s).string();
+    filesystem::remove(path);
+    {
+        WriteAheadLog log(path);
+        search_server.SetWriteAheadLog(&log);
+        search_server.UpdateDocument(7, "попугай кот"s);
+        search_server.UpdateDocument(7, make_text(7));
+        search_server.UpdateDocument(7, make_text(58));
+        search_server.UpdateDocumentAttributes(7, DocumentStatus::IRRELEVANT, {3, 5});
+        search_server.SetWriteAheadLog(nullptr);
+    }
+    reference_server.RemoveDocument(7);
+    reference_server.AddDocument(7, make_text(58), DocumentStatus::IRRELEVANT, {4});
+    SearchServer replayed("и в на"s);
+    replayed.AddDocument(7, "попугай"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(ReplayWriteAheadLog(path, replayed), 3u);
+    filesystem::remove(path);
+    ASSERT_EQUAL(replayed.GetWordFrequencies(7).size(), reference_server.GetWordFrequencies(7).size());
+    ASSERT_EQUAL(replayed.FindTopDocuments("кот пёс хвост"s, DocumentStatus::IRRELEVANT).at(0).rating, 4);
+
+    ASSERT_EQUAL(search_server.GetDocumentCount(), reference_server.GetDocumentCount());
+    for (const string& query : {"кот"s, "кот пёс"s, "хвост -ошейник"s, "+белый попугай"s, "w3 w5"s}) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            AssertSameDocuments(search_server.FindTopDocumentsAfter(query, nullopt, 30, status),
+                                reference_server.FindTopDocumentsAfter(query, nullopt, 30, status), query);
+        }
+    }
+    for (int id = 0; id < 1500; id += 37) {
+        map<string_view, double> freqs;
+        for (const auto& [word, freq] : search_server.GetWordFrequencies(id)) {
+            freqs[word] = freq;
+        }
+        map<string_view, double> expected_freqs;
+        for (const auto& [word, freq] : reference_server.GetWordFrequencies(id)) {
+            expected_freqs[word] = freq;
+        }
+        ASSERT_EQUAL_HINT(freqs, expected_freqs, to_string(id));
+    }
+}
+
 void TestSearchServer() {
     RUN_TEST(TestAddDocument);
     RUN_TEST(TestStopWords);
     RUN_TEST(TestMinusWords);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestPrefixWords);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestFuzzyWords);
+    RUN_TEST(TestTextNormalization);
     RUN_TEST(TestMatching);
+    RUN_TEST(TestMatchDocuments);
+    RUN_TEST(TestWordFrequencies);
     RUN_TEST(TestSortRelevance);
+    RUN_TEST(TestPagination);
+    RUN_TEST(TestChampionLists);
+    RUN_TEST(TestUpdateDocument);
     RUN_TEST(TestCalcRating);
     RUN_TEST(TestFilter);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestFacetCounts);
+    RUN_TEST(TestQueryExplain);
     RUN_TEST(TestStatus);
     RUN_TEST(TestRelevance);
     RUN_TEST(TestDontChangeQuery);
+    RUN_TEST(TestThreadPool);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestAdaptiveExecution);
+    RUN_TEST(TestQueryBudget);
+    RUN_TEST(TestSegments);
+    RUN_TEST(TestImpactScores);
+    RUN_TEST(TestScoreKernels);
+    RUN_TEST(TestDocumentReordering);
+    RUN_TEST(TestMemoryResources);
+    RUN_TEST(TestMemoryBudget);
+    RUN_TEST(TestLoadCorpus);
+    RUN_TEST(TestWriteAheadLog);
+    RUN_TEST(TestQueryServer);
+    RUN_TEST(TestQueryReplay);
 }
@@ -89,13 +89,41 @@ void RunTestImpl(Function test, const string& str_test) {
 void TestAddDocument();
 void TestStopWords();
 void TestMinusWords();
+void TestRequiredWords();
+void TestPrefixWords();
+void TestTermDictionary();
+void TestFuzzyWords();
+void TestTextNormalization();
 void TestMatching();
+void TestMatchDocuments();
+void TestWordFrequencies();
 void TestSortRelevance();
+void TestPagination();
+void TestChampionLists();
+void TestUpdateDocument();
 void TestCalcRating();
 void TestFilter();
+void TestDocumentFilter();
+void TestFacetCounts();
+void TestQueryExplain();
 void TestStatus();
 void TestRelevance();
 void TestDontChangeQuery();
+void TestThreadPool();
+void TestFindTopDocumentsAsync();
+void TestAdaptiveExecution();
+void TestQueryBudget();
+void TestSegments();
+void TestImpactScores();
+void TestScoreKernels();
+void TestDocumentReordering();
+void TestMemoryResources();
+void TestMemoryBudget();
+void TestLoadCorpus();
+void TestWriteAheadLog();
+void TestQueryServer();
+void TestQueryReplay();
+
 void TestSearchServer();
 
 // --------- Окончание модульных тестов поисковой системы -----------
@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+namespace {
+
+// Set for the threads of a pool, lets tasks submitted from a worker land in its own deque
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(sleep_guard_);
+        stop_ = true;
+    }
+    wake_up_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return threads_.size();
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void ThreadPool::Push(Task task, TaskPriority priority) {
+    const size_t worker_index = current_pool == this
+                                ? current_worker
+                                : next_worker_++ % workers_.size();
+    Worker& worker = *workers_[worker_index];
+    {
+        std::lock_guard guard(worker.guard);
+        worker.tasks[static_cast<int>(priority)].push_back(std::move(task));
+    }
+    {
+        // Taken so that a worker can't miss the wake-up between its check and its wait
+        std::lock_guard guard(sleep_guard_);
+        ++pending_tasks_;
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::PopTask(size_t worker_index, Task& task) {
+    for (int priority = 0; priority < PRIORITY_COUNT; ++priority) {
+        {
+            Worker& own = *workers_[worker_index];
+            std::lock_guard guard(own.guard);
+            auto& tasks = own.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                --pending_tasks_;
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            Worker& victim = *workers_[(worker_index + i) % workers_.size()];
+            std::lock_guard guard(victim.guard);
+            auto& tasks = victim.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                --pending_tasks_;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+    while (true) {
+        Task task;
+        if (PopTask(worker_index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock lock(sleep_guard_);
+        wake_up_.wait(lock, [this] {
+            return stop_ || pending_tasks_ > 0;
+        });
+        if (stop_ && pending_tasks_ == 0) {
+            return;
+        }
+    }
+}
+
+ThreadPool& GetDefaultThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
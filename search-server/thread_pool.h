@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class TaskPriority {
+    HIGH,
+    NORMAL,
+    LOW,
+};
+
+// Work-stealing pool, higher priority tasks are always taken first
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function, TaskPriority priority = TaskPriority::NORMAL);
+
+    // The calling thread takes part in the loop and then waits for its chunks only, so it is safe to call
+    // from inside a task and never picks up unrelated work
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    size_t GetThreadCount() const;
+    static size_t GetDefaultThreadCount();
+
+private:
+    using Task = std::function<void()>;
+    static constexpr int PRIORITY_COUNT = 3;
+
+    struct Worker {
+        std::deque<Task> tasks[PRIORITY_COUNT];
+        std::mutex guard;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_tasks_ = 0;
+    std::atomic<size_t> next_worker_ = 0;
+    std::atomic<bool> stop_ = false;
+    std::mutex sleep_guard_;
+    std::condition_variable wake_up_;
+
+    void Push(Task task, TaskPriority priority);
+    bool PopTask(size_t worker_index, Task& task);
+    void WorkerLoop(size_t worker_index);
+};
+
+// The pool shared by all servers that were not given their own
+ThreadPool& GetDefaultThreadPool();
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> ThreadPool::Submit(Function function, TaskPriority priority) {
+    using Result = std::invoke_result_t<Function>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+    std::future<Result> result = task->get_future();
+    Push([task] { (*task)(); }, priority);
+    return result;
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+
+    struct LoopState {
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> done_count = 0;
+        std::exception_ptr error;
+        std::mutex guard;
+        std::condition_variable all_done;
+    };
+    auto state = std::make_shared<LoopState>();
+
+    auto run = [state, count, &function] {
+        size_t index;
+        while ((index = state->next_index++) < count) {
+            try {
+                function(index);
+            } catch (...) {
+                std::lock_guard guard(state->guard);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            if (++state->done_count == count) {
+                std::lock_guard guard(state->guard);
+                state->all_done.notify_all();
+            }
+        }
+    };
+
+    // A helper that starts after the loop is over finds no indices and never touches function
+    const size_t helper_count = std::min(count, GetThreadCount()) - 1;
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push(run, TaskPriority::HIGH);
+    }
+    // Once the caller runs out of indices every chunk is taken by a running thread
+    run();
+    std::unique_lock lock(state->guard);
+    state->all_done.wait(lock, [&state, count] {
+        return state->done_count == count;
+    });
+
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
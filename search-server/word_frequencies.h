@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+struct TermFrequency {
+    int term_id;
+    double term_freq;
+};
+
+// Valid until the next index mutation
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        Iterator(const TermFrequency* entry, const std::string_view* term_words)
+        : entry_(entry)
+        , term_words_(term_words)
+        {
+        }
+
+        value_type operator*() const {
+            return {term_words_[entry_->term_id], entry_->term_freq};
+        }
+
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++entry_;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const TermFrequency* entry_ = nullptr;
+        const std::string_view* term_words_ = nullptr;
+    };
+
+    WordFrequencies() = default;
+
+    WordFrequencies(const TermFrequency* first, const TermFrequency* last, const std::string_view* term_words)
+    : first_(first)
+    , last_(last)
+    , term_words_(term_words)
+    {
+    }
+
+    Iterator begin() const {
+        return {first_, term_words_};
+    }
+
+    Iterator end() const {
+        return {last_, term_words_};
+    }
+
+    size_t size() const {
+        return last_ - first_;
+    }
+
+    bool empty() const {
+        return first_ == last_;
+    }
+
+private:
+    const TermFrequency* first_ = nullptr;
+    const TermFrequency* last_ = nullptr;
+    const std::string_view* term_words_ = nullptr;
+};
@@ -0,0 +1,385 @@
+#include "write_ahead_log.h"
+#include "mapped_file.h"
+#include "search_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+enum class RecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+    UPDATE_DOCUMENT = 3,
+    UPDATE_DOCUMENT_ATTRIBUTES = 4,
+};
+
+// Record layout: payload size (4 bytes), checksum of the payload (4 bytes), payload.
+// All numbers are stored in the byte order of the host.
+const size_t RECORD_HEADER_SIZE = 8;
+
+// Set while the thread runs a batch of the log
+thread_local const WriteAheadLog* batched_log = nullptr;
+thread_local size_t batch_depth = 0;
+
+// FNV-1a
+uint32_t ComputeChecksum(std::string_view data) {
+    uint32_t hash = 2166136261u;
+    for (const char c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename Number>
+void PutNumber(std::string& out, Number value) {
+    char bytes[sizeof(Number)];
+    std::memcpy(bytes, &value, sizeof(Number));
+    out.append(bytes, sizeof(Number));
+}
+
+void PutAttributes(std::string& out, DocumentStatus status, const std::vector<int>& ratings) {
+    PutNumber(out, static_cast<uint8_t>(status));
+    PutNumber(out, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        PutNumber(out, static_cast<int32_t>(rating));
+    }
+}
+
+void PutText(std::string& out, std::string_view text) {
+    PutNumber(out, static_cast<uint32_t>(text.size()));
+    out.append(text);
+}
+
+// Returns false if the data is too short
+template <typename Number>
+bool TakeNumber(std::string_view& data, Number& value) {
+    if (data.size() < sizeof(Number)) {
+        return false;
+    }
+    std::memcpy(&value, data.data(), sizeof(Number));
+    data.remove_prefix(sizeof(Number));
+    return true;
+}
+
+// Returns false if the data is too short
+bool TakeAttributes(std::string_view& data, DocumentStatus& status, std::vector<int>& ratings) {
+    uint8_t status_value = 0;
+    uint32_t rating_count = 0;
+    if (!TakeNumber(data, status_value) || !TakeNumber(data, rating_count)) {
+        return false;
+    }
+    status = static_cast<DocumentStatus>(status_value);
+    ratings.resize(rating_count);
+    for (int& rating : ratings) {
+        int32_t value = 0;
+        if (!TakeNumber(data, value)) {
+            return false;
+        }
+        rating = value;
+    }
+    return true;
+}
+
+// The text must take the rest of the data
+bool TakeText(std::string_view& data, std::string_view& text) {
+    uint32_t text_size = 0;
+    if (!TakeNumber(data, text_size) || data.size() != text_size) {
+        return false;
+    }
+    text = data;
+    data.remove_prefix(text_size);
+    return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, DurabilityMode mode)
+: mode_(mode)
+{
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Can't open write-ahead log " + path);
+    }
+    if (mode_ != DurabilityMode::SYNC) {
+        flusher_ = std::thread([this] { FlusherLoop(); });
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::unique_lock lock(guard_);
+        stop_ = true;
+        flush_requested_.notify_one();
+    }
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    // The flusher drains the buffer before it stops, a failed write is not retried here
+    close(fd_);
+}
+
+DurabilityMode WriteAheadLog::GetMode() const {
+    return mode_;
+}
+
+uint64_t WriteAheadLog::GetSyncCount() const {
+    return sync_count_;
+}
+
+void WriteAheadLog::BeginBatch() {
+    if (batch_depth++ == 0) {
+        batched_log = this;
+    }
+}
+
+void WriteAheadLog::EndBatch() {
+    if (--batch_depth > 0) {
+        return;
+    }
+    const bool is_batched = batched_log == this;
+    batched_log = nullptr;
+    if (is_batched && mode_ == DurabilityMode::GROUP_COMMIT) {
+        Sync();
+    }
+}
+
+void WriteAheadLog::LogAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    std::string payload;
+    payload.reserve(16 + ratings.size() * sizeof(int) + document.size());
+    PutNumber(payload, static_cast<uint8_t>(RecordType::ADD_DOCUMENT));
+    PutNumber(payload, static_cast<int32_t>(document_id));
+    PutAttributes(payload, status, ratings);
+    PutText(payload, document);
+    Append(payload);
+}
+
+void WriteAheadLog::LogRemoveDocument(int document_id) {
+    std::string payload;
+    PutNumber(payload, static_cast<uint8_t>(RecordType::REMOVE_DOCUMENT));
+    PutNumber(payload, static_cast<int32_t>(document_id));
+    Append(payload);
+}
+
+void WriteAheadLog::LogUpdateDocument(int document_id, std::string_view document) {
+    std::string payload;
+    payload.reserve(16 + document.size());
+    PutNumber(payload, static_cast<uint8_t>(RecordType::UPDATE_DOCUMENT));
+    PutNumber(payload, static_cast<int32_t>(document_id));
+    PutText(payload, document);
+    Append(payload);
+}
+
+void WriteAheadLog::LogUpdateDocumentAttributes(int document_id, DocumentStatus status, const std::vector<int>& ratings) {
+    std::string payload;
+    PutNumber(payload, static_cast<uint8_t>(RecordType::UPDATE_DOCUMENT_ATTRIBUTES));
+    PutNumber(payload, static_cast<int32_t>(document_id));
+    PutAttributes(payload, status, ratings);
+    Append(payload);
+}
+
+void WriteAheadLog::Append(const std::string& payload) {
+    std::unique_lock lock(guard_);
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+    PutNumber(buffer_, static_cast<uint32_t>(payload.size()));
+    PutNumber(buffer_, ComputeChecksum(payload));
+    buffer_ += payload;
+    const uint64_t count = ++appended_count_;
+
+    switch (mode_) {
+        case DurabilityMode::SYNC:
+            FlushLocked(lock);
+            break;
+        case DurabilityMode::GROUP_COMMIT:
+            if (batched_log != this) {
+                flush_requested_.notify_one();
+                WaitSynced(lock, count);
+            } else if (buffer_.size() >= WAL_BUFFER_LIMIT) {
+                flush_requested_.notify_one();
+            }
+            break;
+        case DurabilityMode::PERIODIC:
+            if (buffer_.size() >= WAL_BUFFER_LIMIT) {
+                flush_requested_.notify_one();
+            }
+            break;
+    }
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+void WriteAheadLog::Sync() {
+    std::unique_lock lock(guard_);
+    if (mode_ == DurabilityMode::SYNC) {
+        FlushLocked(lock);
+    } else {
+        flush_requested_.notify_one();
+        WaitSynced(lock, appended_count_);
+    }
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+void WriteAheadLog::Truncate() {
+    std::unique_lock lock(guard_);
+    flush_done_.wait(lock, [this] { return !is_flushing_; });
+    buffer_.clear();
+    synced_count_ = appended_count_;
+    if (ftruncate(fd_, 0) != 0 || fsync(fd_) != 0) {
+        error_ = "Can't truncate write-ahead log";
+        throw std::runtime_error(error_);
+    }
+    flush_done_.notify_all();
+}
+
+void WriteAheadLog::FlushLocked(std::unique_lock<std::mutex>& lock) {
+    // One flush at a time keeps the records in order in the file
+    flush_done_.wait(lock, [this] { return !is_flushing_; });
+    if (buffer_.empty()) {
+        return;
+    }
+    std::string data;
+    data.swap(buffer_);
+    const uint64_t count = appended_count_;
+    is_flushing_ = true;
+
+    // Appenders keep filling the buffer while this batch is being synced
+    lock.unlock();
+    std::string error;
+    try {
+        WriteAndSync(data);
+    } catch (const std::runtime_error& e) {
+        error = e.what();
+    }
+    lock.lock();
+
+    is_flushing_ = false;
+    if (error.empty()) {
+        synced_count_ = count;
+        ++sync_count_;
+    } else {
+        error_ = error;
+    }
+    flush_done_.notify_all();
+}
+
+void WriteAheadLog::WriteAndSync(const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = write(fd_, data.data() + written, data.size() - written);
+        if (result < 0) {
+            throw std::runtime_error("Can't write to write-ahead log");
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (fdatasync(fd_) != 0) {
+        throw std::runtime_error("Can't sync write-ahead log");
+    }
+}
+
+void WriteAheadLog::WaitSynced(std::unique_lock<std::mutex>& lock, uint64_t count) {
+    flush_done_.wait(lock, [this, count] { return synced_count_ >= count || !error_.empty(); });
+}
+
+void WriteAheadLog::FlusherLoop() {
+    std::unique_lock lock(guard_);
+    while (true) {
+        if (mode_ == DurabilityMode::PERIODIC) {
+            flush_requested_.wait_for(lock, WAL_FLUSH_INTERVAL, [this] {
+                return stop_ || buffer_.size() >= WAL_BUFFER_LIMIT;
+            });
+        } else {
+            flush_requested_.wait(lock, [this] { return stop_ || !buffer_.empty(); });
+        }
+        FlushLocked(lock);
+        if (stop_ && buffer_.empty()) {
+            return;
+        }
+    }
+}
+
+size_t ReplayWriteAheadLog(const std::string& path, SearchServer& search_server) {
+    // No log yet on the first start
+    if (access(path.c_str(), F_OK) != 0 && errno == ENOENT) {
+        return 0;
+    }
+    size_t valid_size = 0;
+    size_t record_count = 0;
+    {
+        const MappedFile file(path);
+        const std::string_view log = file.GetText();
+        std::vector<int> ratings;
+
+        while (true) {
+            std::string_view data = log.substr(valid_size);
+            uint32_t payload_size = 0;
+            uint32_t checksum = 0;
+            if (!TakeNumber(data, payload_size) || !TakeNumber(data, checksum) || data.size() < payload_size) {
+                break;
+            }
+            std::string_view payload = data.substr(0, payload_size);
+            if (ComputeChecksum(payload) != checksum) {
+                break;
+            }
+
+            uint8_t type = 0;
+            int32_t document_id = 0;
+            if (!TakeNumber(payload, type) || !TakeNumber(payload, document_id)) {
+                break;
+            }
+            DocumentStatus status = DocumentStatus::ACTUAL;
+            std::string_view text;
+            if (type == static_cast<uint8_t>(RecordType::ADD_DOCUMENT)) {
+                if (!TakeAttributes(payload, status, ratings) || !TakeText(payload, text)) {
+                    break;
+                }
+                // The text is indexed straight from the mapping
+                search_server.RemoveDocument(document_id);
+                search_server.AddDocument(document_id, text, status, ratings);
+            } else if (type == static_cast<uint8_t>(RecordType::REMOVE_DOCUMENT)) {
+                search_server.RemoveDocument(document_id);
+            } else if (type == static_cast<uint8_t>(RecordType::UPDATE_DOCUMENT)) {
+                if (!TakeText(payload, text)) {
+                    break;
+                }
+                // A document removed after the update isn't in an index that already reflects the removal
+                try {
+                    search_server.UpdateDocument(document_id, text);
+                } catch (const std::out_of_range&) {
+                }
+            } else if (type == static_cast<uint8_t>(RecordType::UPDATE_DOCUMENT_ATTRIBUTES)) {
+                if (!TakeAttributes(payload, status, ratings)) {
+                    break;
+                }
+                try {
+                    search_server.UpdateDocumentAttributes(document_id, status, ratings);
+                } catch (const std::out_of_range&) {
+                }
+            } else {
+                break;
+            }
+
+            valid_size += RECORD_HEADER_SIZE + payload_size;
+            ++record_count;
+        }
+
+        if (valid_size == log.size()) {
+            return record_count;
+        }
+    }
+
+    // New records must follow the last valid one, not the garbage after it
+    if (truncate(path.c_str(), static_cast<off_t>(valid_size)) != 0) {
+        throw std::runtime_error("Can't cut torn tail of write-ahead log " + path);
+    }
+    return record_count;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+
+class SearchServer;
+
+const std::chrono::milliseconds WAL_FLUSH_INTERVAL(10);
+// Buffered bytes that wake the flusher before the interval ends
+const size_t WAL_BUFFER_LIMIT = 1 << 20;
+
+enum class DurabilityMode {
+    // A crash loses at most the last WAL_FLUSH_INTERVAL
+    PERIODIC,
+    // Concurrent appenders share one fsync
+    GROUP_COMMIT,
+    SYNC,
+};
+
+// Records are length-prefixed and checksummed, a torn record at the end is dropped on replay
+class WriteAheadLog {
+public:
+    // Throws std::runtime_error if the file can't be opened
+    explicit WriteAheadLog(const std::string& path, DurabilityMode mode = DurabilityMode::GROUP_COMMIT);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Throw std::runtime_error if the log can't be written
+    void LogAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void LogRemoveDocument(int document_id);
+    void LogUpdateDocument(int document_id, std::string_view document);
+    void LogUpdateDocumentAttributes(int document_id, DocumentStatus status, const std::vector<int>& ratings);
+
+    void Sync();
+    // Drops all records
+    void Truncate();
+
+    // In GROUP_COMMIT mode records the calling thread logs until EndBatch don't wait for their sync, EndBatch waits
+    // for all of them at once. Throws std::runtime_error if they can't be written.
+    void BeginBatch();
+    void EndBatch();
+
+    DurabilityMode GetMode() const;
+    uint64_t GetSyncCount() const;
+
+private:
+    const DurabilityMode mode_;
+    int fd_ = -1;
+
+    std::mutex guard_;
+    std::condition_variable flush_requested_;
+    std::condition_variable flush_done_;
+    std::string buffer_;
+    uint64_t appended_count_ = 0;
+    uint64_t synced_count_ = 0;
+    bool is_flushing_ = false;
+    bool stop_ = false;
+    std::atomic<uint64_t> sync_count_ = 0;
+    std::string error_;
+    std::thread flusher_;
+
+    void Append(const std::string& payload);
+    void FlushLocked(std::unique_lock<std::mutex>& lock);
+    void WriteAndSync(const std::string& data);
+    void WaitSynced(std::unique_lock<std::mutex>& lock, uint64_t count);
+    void FlusherLoop();
+};
+
+// Applies the records on top of the documents the index already has, an added document replaces one with
+// the same id. A torn record at the end is cut off the file. Returns the number of applied records, 0 if there
+// is no file at path. The server must not have this log attached while replaying.
+size_t ReplayWriteAheadLog(const std::string& path, SearchServer& search_server);